@@ -0,0 +1,294 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+
+namespace cp {
+
+// log file written only at its end, safe to use from many threads. space is preallocated in
+// large chunks with FALLOC_FL_KEEP_SIZE, so appends do not allocate blocks one by one and the
+// file does not fragment, while file size still tells where the log ends. records are written
+// with pwrite at offsets reserved under a lock, writes themselves run in parallel. durability is
+// requested with sync, threads that wait for it at the same time share one fdatasync. after a
+// failed fdatasync it is not known what reached the disk, and after a failed write the log has a
+// gap, so in both cases every later sync fails with the same error
+class append_log
+{
+  append_log(append_log const&) = delete;
+  append_log& operator = (append_log const&) = delete;
+
+public:
+  struct options
+  {
+    // bytes preallocated at once, 0 disables preallocation
+    ::off_t chunk_size = 64 * 1024 * 1024;
+  };
+
+  // log continues at the current size of the file
+  append_log(::cp::file_descriptor fd, options const& opts, std::error_code& ec)
+    : fd_(std::move(fd))
+    , options_(opts)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    open(ec);
+  }
+
+  explicit append_log(::cp::file_descriptor fd) : append_log(std::move(fd), options()) { }
+
+  append_log(::cp::file_descriptor fd, options const& opts)
+    : fd_(std::move(fd))
+    , options_(opts)
+  {
+    std::error_code ec;
+    open(ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "append_log fd: [", fd_, "]");
+    }
+  }
+
+  // opened with O_WRONLY | O_CREAT | O_CLOEXEC
+  append_log(const char* pathname, ::mode_t mode, options const& opts, std::error_code& ec)
+    : options_(opts)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    fd_ = ::cp::open(pathname, O_WRONLY | O_CREAT | O_CLOEXEC, mode, ec);
+    if (CP_LIKELY(!ec)) open(ec);
+  }
+
+  append_log(const char* pathname, ::mode_t mode) : append_log(pathname, mode, options()) { }
+
+  append_log(const char* pathname, ::mode_t mode, options const& opts)
+    : options_(opts)
+  {
+    std::error_code ec;
+    fd_ = ::cp::open(pathname, O_WRONLY | O_CREAT | O_CLOEXEC, mode, ec);
+    if (CP_LIKELY(!ec)) open(ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "append_log pathname: [", pathname, "]");
+    }
+  }
+
+  // writes record at the end of the log and returns log position after it, pass it to sync to
+  // make the record durable. on error space of the record stays reserved and the log has a gap,
+  // every later sync fails with the error since records after the gap can not be made durable
+  std::uint64_t append(const void* data, std::size_t nbytes, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(data || 0 == nbytes);
+
+    ::off_t offset;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (CP_UNLIKELY(0 == nbytes)) return std::uint64_t(end_);
+      offset = end_;
+      end_  += ::off_t(nbytes);
+      if (end_ > allocated_) preallocate(end_);
+      pending_.emplace(offset, pending_append{ end_, false });
+    }
+
+    ::cp::pwrite_all(fd_, data, nbytes, offset, ec);
+    complete(offset, ec);
+    return std::uint64_t(offset) + nbytes;
+  }
+
+  std::uint64_t append(const void* data, std::size_t nbytes)
+  {
+    std::error_code ec;
+    const std::uint64_t result = append(data, nbytes, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "append_log::append fd: [", fd_, "], nbytes: [", nbytes, "]");
+    }
+    return result;
+  }
+
+  // returns when everything before position is on disk. waits for appends of other threads
+  // that end before position and joins fdatasync that is already running or starts one
+  void sync(std::uint64_t position, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    CP_ASSERT(position <= std::uint64_t(end_));
+    for (;;)
+    {
+      if (CP_UNLIKELY(failed_))
+      {
+        ec = failed_;
+        return;
+      }
+      if (durable_ >= position) return;
+
+      if (syncing_ || written_ < position)
+      {
+        changed_.wait(lock);
+        continue;
+      }
+
+      // this thread syncs for everybody, appends written by now are covered
+      syncing_ = true;
+      const std::uint64_t target = written_;
+      lock.unlock();
+
+      std::error_code sync_ec;
+      ::cp::fdatasync(fd_, sync_ec);
+
+      lock.lock();
+      syncing_ = false;
+      ++syncs_;
+      if (CP_UNLIKELY(sync_ec)) failed_ = sync_ec;
+      else durable_ = std::max(durable_, target);
+      changed_.notify_all();
+    }
+  }
+
+  void sync(std::uint64_t position)
+  {
+    std::error_code ec;
+    sync(position, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "append_log::sync fd: [", fd_, "], position: [", position, "]");
+    }
+  }
+
+  // everything appended so far
+  void sync(std::error_code& ec) noexcept { sync(end(), ec); }
+  void sync()                             { sync(end());     }
+
+  // append followed by sync
+  std::uint64_t commit(const void* data, std::size_t nbytes, std::error_code& ec)
+  {
+    const std::uint64_t position = append(data, nbytes, ec);
+    if (CP_LIKELY(!ec)) sync(position, ec);
+    return position;
+  }
+
+  std::uint64_t commit(const void* data, std::size_t nbytes)
+  {
+    std::error_code ec;
+    const std::uint64_t result = commit(data, nbytes, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "append_log::commit fd: [", fd_, "], nbytes: [", nbytes, "]");
+    }
+    return result;
+  }
+
+  std::uint64_t end() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::uint64_t(end_);
+  }
+
+  std::uint64_t durable() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return durable_;
+  }
+
+  // number of fdatasync calls made, lower than number of synced records when they were grouped
+  std::uint64_t syncs() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return syncs_;
+  }
+
+  ::cp::file_descriptor const& fd() const noexcept { return fd_; }
+
+private:
+  void open(std::error_code& ec)
+  {
+    CP_ASSERT(options_.chunk_size >= 0);
+
+    ::cp::file_info info;
+    ::cp::fstat(fd_, info, ec);
+    if (CP_UNLIKELY(ec)) return;
+    end_       = info.size();
+    allocated_ = end_;
+    written_   = std::uint64_t(end_);
+    durable_   = 0;
+  }
+
+  // failure is not an error, appends then allocate as they go
+  void preallocate(::off_t needed) noexcept
+  {
+    if (0 == options_.chunk_size || !preallocate_) return;
+
+    const ::off_t target = (needed + options_.chunk_size - 1) / options_.chunk_size * options_.chunk_size;
+    std::error_code ec;
+    ::cp::preallocate(fd_, allocated_, target - allocated_, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      if (ec == std::errc::operation_not_supported) preallocate_ = false;
+      return;
+    }
+    allocated_ = target;
+  }
+
+  // records finished out of order wait in pending_ until the ones before them finish. written_
+  // moves past a failed record too, failed_ then keeps syncs from reporting it durable
+  void complete(::off_t offset, std::error_code const& ec) noexcept
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (CP_UNLIKELY(ec) && !failed_)
+    {
+      failed_ = ec;
+      changed_.notify_all();
+    }
+    auto it = pending_.find(offset);
+    CP_ASSERT(it != pending_.end());
+    it->second.done = true;
+
+    bool advanced = false;
+    for (auto first = pending_.begin(); first != pending_.end() && first->second.done; first = pending_.erase(first))
+    {
+      written_ = std::uint64_t(first->second.end);
+      advanced = true;
+    }
+    if (advanced) changed_.notify_all();
+  }
+
+  struct pending_append
+  {
+    ::off_t end;
+    bool    done;
+  };
+
+  ::cp::file_descriptor         fd_;
+  options const                 options_;
+  mutable std::mutex            mutex_;
+  std::condition_variable       changed_;
+  ::off_t                       end_         = 0;     // where the next record goes
+  ::off_t                       allocated_   = 0;     // preallocated up to
+  std::map<::off_t, pending_append> pending_;         // appends being written, by offset
+  std::uint64_t                 written_     = 0;     // everything before it is written
+  std::uint64_t                 durable_     = 0;     // everything before it is synced
+  std::uint64_t                 syncs_       = 0;
+  std::error_code               failed_;
+  bool                          syncing_     = false;
+  bool                          preallocate_ = true;
+};
+
+} // namespace cp
+
+#endif
@@ -0,0 +1,146 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+#include "temp_file.h"
+
+#include <cstddef>
+
+#if (_POSIX_C_SOURCE >= 200809L)
+
+namespace cp {
+
+// replaces whole files in one directory so that after a crash every name has either its old or its
+// new content. each file is written to a temp_file, its data is synced with fdatasync and only then
+// it is renamed over the old name, so a name never points to data that is not on disk. renames
+// themselves become durable with the directory fsync made by commit, one for all files written
+// since the previous commit. new content is visible to readers as soon as write returns, durable
+// after commit returns. dirfd is not owned and must outlive the batch, and must not be opened with
+// O_PATH when durable is set. nothing is committed by the destructor
+class atomic_write_batch
+{
+  atomic_write_batch(atomic_write_batch const&) = delete;
+  atomic_write_batch& operator = (atomic_write_batch const&) = delete;
+
+public:
+  struct options
+  {
+    ::mode_t mode      = 0644;
+
+    // without it nothing is synced, files are still replaced atomically for running readers
+    bool     durable   = true;
+
+    // write fails with EEXIST when name exists instead of replacing it
+    bool     exclusive = false;
+  };
+
+  explicit atomic_write_batch(::cp::file_descriptor const& dirfd) : atomic_write_batch(dirfd, options()) { }
+
+  atomic_write_batch(::cp::file_descriptor const& dirfd, options const& opts)
+    : dirfd_(&dirfd), options_(opts)
+  {
+    CP_ASSERT(dirfd);
+  }
+
+  // name gets content data, the old file if any is replaced
+  void write(const char* name, const void* data, std::size_t nbytes, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(name);
+    CP_ASSERT(data || 0 == nbytes);
+
+    ::cp::temp_file::options temp_options;
+    temp_options.mode    = options_.mode;
+    temp_options.durable = false;         // file and directory are synced here, separately
+
+    ::cp::temp_file file(*dirfd_, temp_options, ec);
+    if (CP_UNLIKELY(ec)) return;
+    file.write(data, nbytes, ec);
+    if (CP_UNLIKELY(ec)) return;
+
+    if (options_.durable)
+    {
+      ::cp::fdatasync(file.fd(), ec);
+      if (CP_UNLIKELY(ec)) return;
+    }
+
+    if (options_.exclusive) file.publish(name, ec);
+    else file.replace(name, ec);
+    if (CP_LIKELY(!ec)) ++pending_;
+  }
+
+  void write(const char* name, const void* data, std::size_t nbytes)
+  {
+    std::error_code ec;
+    write(name, data, nbytes, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "atomic_write_batch::write dirfd: [", *dirfd_, "], name: [", name, "], nbytes: [", nbytes, "]");
+    }
+  }
+
+  // makes names written since the previous commit durable with one fsync of the directory, does
+  // nothing when there are none or durable is not set
+  void commit(std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    if (0 == pending_ || !options_.durable) return;
+    ::cp::fsync(*dirfd_, ec);
+    if (CP_LIKELY(!ec)) pending_ = 0;
+  }
+
+  void commit()
+  {
+    std::error_code ec;
+    commit(ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "atomic_write_batch::commit dirfd: [", *dirfd_, "], pending: [", pending_, "]");
+    }
+  }
+
+  // files written and not yet committed
+  std::size_t pending() const noexcept { return pending_; }
+
+private:
+  ::cp::file_descriptor const* dirfd_;
+  options const                options_;
+  std::size_t                  pending_ = 0;
+};
+
+// name in dirfd gets content data, atomically and durably: fdatasync of the new file, rename over
+// the old one and fsync of the directory, in that order
+inline
+void atomic_write_file(::cp::file_descriptor const& dirfd, const char* name, const void* data, std::size_t nbytes, ::mode_t mode, std::error_code& ec)
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+
+  ::cp::atomic_write_batch::options opts;
+  opts.mode = mode;
+  ::cp::atomic_write_batch batch(dirfd, opts);
+  batch.write(name, data, nbytes, ec);
+  if (CP_LIKELY(!ec)) batch.commit(ec);
+}
+
+inline
+void atomic_write_file(::cp::file_descriptor const& dirfd, const char* name, const void* data, std::size_t nbytes, ::mode_t mode = 0644)
+{
+  std::error_code ec;
+  ::cp::atomic_write_file(dirfd, name, data, nbytes, mode, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "atomic_write_file dirfd: [", dirfd, "], name: [", name, "], nbytes: [", nbytes, "]");
+  }
+}
+
+} // namespace cp
+
+#endif
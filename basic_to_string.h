@@ -9,6 +9,10 @@
 #include <string>
 #include <cstring>
 #include <algorithm>
+#include <charconv>
+#include <system_error>
+#include <type_traits>
+#include <utility>
 
 namespace cp
 {
@@ -28,15 +32,82 @@ namespace cp
   inline std::string to_string(double value)             { return ::std::to_string(value); }
   inline std::string to_string(long double value)        { return ::std::to_string(value); }
 
+  // same values can be written into a caller supplied buffer without allocation. on success
+  // result.ec is std::errc() and result.ptr points one past the last written character, when the
+  // buffer is too small result.ec is std::errc::value_too_large and the buffer content is unspecified
+  inline std::to_chars_result to_chars(char* first, char* last, const char* s, std::size_t size) noexcept
+  {
+    if (std::size_t(last - first) < size) return { last, std::errc::value_too_large };
+    std::memcpy(first, s, size);
+    return { first + size, std::errc() };
+  }
+
+  inline std::to_chars_result to_chars(char* first, char* last, std::string const& s) noexcept { return ::cp::to_chars(first, last, s.data(), s.size()); }
+  inline std::to_chars_result to_chars(char* first, char* last, const char* s) noexcept        { return s ? ::cp::to_chars(first, last, s, std::strlen(s)) : ::cp::to_chars(first, last, "nullptr", 7); }
+  inline std::to_chars_result to_chars(char* first, char* last, char* s) noexcept              { return ::cp::to_chars(first, last, const_cast<const char*>(s)); }
+
+  inline std::to_chars_result to_chars(char* first, char* last, int value) noexcept                { return ::std::to_chars(first, last, value); }
+  inline std::to_chars_result to_chars(char* first, char* last, long value) noexcept               { return ::std::to_chars(first, last, value); }
+  inline std::to_chars_result to_chars(char* first, char* last, long long value) noexcept          { return ::std::to_chars(first, last, value); }
+  inline std::to_chars_result to_chars(char* first, char* last, unsigned value) noexcept           { return ::std::to_chars(first, last, value); }
+  inline std::to_chars_result to_chars(char* first, char* last, unsigned long value) noexcept      { return ::std::to_chars(first, last, value); }
+  inline std::to_chars_result to_chars(char* first, char* last, unsigned long long value) noexcept { return ::std::to_chars(first, last, value); }
+  // fixed with precision 6 gives the same text as std::to_string
+  inline std::to_chars_result to_chars(char* first, char* last, float value) noexcept              { return ::std::to_chars(first, last, value, ::std::chars_format::fixed, 6); }
+  inline std::to_chars_result to_chars(char* first, char* last, double value) noexcept             { return ::std::to_chars(first, last, value, ::std::chars_format::fixed, 6); }
+  inline std::to_chars_result to_chars(char* first, char* last, long double value) noexcept        { return ::std::to_chars(first, last, value, ::std::chars_format::fixed, 6); }
+
   template <typename T> struct serialization_traits;
 
-#define CP_DEFINE_SERIALIZATION_SPECIALIZATION( TYPE )     \
-  template <>                                              \
-  struct serialization_traits<TYPE> {                      \
-    static ::std::string to_string(TYPE const&  value) {   \
-      return ::cp::to_string(value);                       \
-    }                                                      \
-  }     
+  namespace detail
+  {
+    // true when serialization_traits<T> provide to_chars, types that only provide to_string are
+    // formatted through a temporary string
+    template <typename T, typename = void>
+    struct has_to_chars : std::false_type { };
+
+    template <typename T>
+    struct has_to_chars<T, std::void_t<decltype(::cp::serialization_traits<T>::to_chars(
+      std::declval<char*>(), std::declval<char*>(), std::declval<T const&>()))>> : std::true_type { };
+  }
+
+  // appends value to out, values are formatted on the stack first so the only allocation is the
+  // growth of out itself
+  inline void append(std::string& out, std::string const& s) { out.append(s);                   }
+  inline void append(std::string& out, const char* s)        { out.append(s ? s : "nullptr");   }
+  inline void append(std::string& out, char* s)              { out.append(s ? s : "nullptr");   }
+
+  template <typename T>
+  inline void append(std::string& out, T const& value)
+  {
+    if constexpr (::cp::detail::has_to_chars<T>::value) {
+      char buffer[64];
+      const std::to_chars_result result = ::cp::serialization_traits<T>::to_chars(buffer, buffer + sizeof(buffer), value);
+      if (result.ec == std::errc()) {
+        out.append(buffer, result.ptr);
+        return;
+      }
+    }
+    out.append(::cp::serialization_traits<T>::to_string(value));
+  }
+
+// to_chars is generated only when ::cp::to_chars is defined for TYPE, types that only have
+// ::cp::to_string get to_string and append
+#define CP_DEFINE_SERIALIZATION_SPECIALIZATION( TYPE )                                   \
+  template <>                                                                            \
+  struct serialization_traits<TYPE> {                                                    \
+    static ::std::string to_string(TYPE const&  value) {                                 \
+      return ::cp::to_string(value);                                                     \
+    }                                                                                    \
+    template <typename U = TYPE, typename = decltype(::cp::to_chars(                     \
+      ::std::declval<char*>(), ::std::declval<char*>(), ::std::declval<U const&>()))>    \
+    static ::std::to_chars_result to_chars(char* first, char* last, TYPE const& value) { \
+      return ::cp::to_chars(first, last, static_cast<U const&>(value));                  \
+    }                                                                                    \
+    static void append(::std::string& out, TYPE const& value) {                          \
+      ::cp::append(out, value);                                                          \
+    }                                                                                    \
+  }
 
 CP_DEFINE_SERIALIZATION_SPECIALIZATION(::std::string);
 CP_DEFINE_SERIALIZATION_SPECIALIZATION(const char* );
@@ -51,4 +122,11 @@ CP_DEFINE_SERIALIZATION_SPECIALIZATION(float);
 CP_DEFINE_SERIALIZATION_SPECIALIZATION(double);
 CP_DEFINE_SERIALIZATION_SPECIALIZATION(long double);
 
+  // compile check, a type that only has ::cp::to_string still gets its serialization_traits
+  namespace detail { struct to_string_only { }; }
+  inline std::string to_string(::cp::detail::to_string_only const&) { return "to_string_only"; }
+CP_DEFINE_SERIALIZATION_SPECIALIZATION(::cp::detail::to_string_only);
+  static_assert(!::cp::detail::has_to_chars<::cp::detail::to_string_only>::value);
+  static_assert(::cp::detail::has_to_chars<int>::value);
+
 }
\ No newline at end of file
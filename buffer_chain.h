@@ -0,0 +1,458 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <limits.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+namespace cp {
+
+// list of buffers for vectored i/o. first InlineCapacity entries are stored in the object, longer
+// chains move to the heap. buffers are not owned, they must outlive the chain. empty buffers are
+// not stored. consume removes bytes from the front after a partial transfer
+template <std::size_t InlineCapacity>
+class basic_buffer_chain
+{
+  static_assert(InlineCapacity > 0);
+
+public:
+  basic_buffer_chain() noexcept = default;
+
+  basic_buffer_chain(basic_buffer_chain const& other)
+  {
+    append(other);
+  }
+
+  basic_buffer_chain(basic_buffer_chain&& other) noexcept
+  {
+    take(other);
+  }
+
+  basic_buffer_chain& operator = (basic_buffer_chain const& other)
+  {
+    if (this != &other)
+    {
+      clear();
+      append(other);
+    }
+    return *this;
+  }
+
+  basic_buffer_chain& operator = (basic_buffer_chain&& other) noexcept
+  {
+    if (this != &other)
+    {
+      clear();
+      heap_.reset();
+      data_     = inline_;
+      capacity_ = InlineCapacity;
+      take(other);
+    }
+    return *this;
+  }
+
+  static constexpr std::size_t inline_capacity() noexcept { return InlineCapacity; }
+
+  // buffers for writing, they are only read by writev and pwritev
+  basic_buffer_chain& append(const void* data, std::size_t size)
+  {
+    if (0 != size) emplace_back(const_cast<void*>(data), size);
+    return *this;
+  }
+
+  basic_buffer_chain& append(std::string_view s)            { return append(s.data(), s.size()); }
+
+  // buffers for reading, readv and preadv fill them
+  basic_buffer_chain& append(void* data, std::size_t size)
+  {
+    if (0 != size) emplace_back(data, size);
+    return *this;
+  }
+
+  basic_buffer_chain& append(::iovec const& iov)           { return append(iov.iov_base, iov.iov_len); }
+
+  template <std::size_t N>
+  basic_buffer_chain& append(basic_buffer_chain<N> const& other)
+  {
+    reserve(count() + other.count());
+    for (::iovec const& iov : other) append(iov);
+    return *this;
+  }
+
+  basic_buffer_chain& prepend(const void* data, std::size_t size)
+  {
+    if (0 != size) emplace_front(const_cast<void*>(data), size);
+    return *this;
+  }
+
+  basic_buffer_chain& prepend(std::string_view s)           { return prepend(s.data(), s.size()); }
+
+  basic_buffer_chain& prepend(void* data, std::size_t size)
+  {
+    if (0 != size) emplace_front(data, size);
+    return *this;
+  }
+
+  basic_buffer_chain& prepend(::iovec const& iov)          { return prepend(iov.iov_base, iov.iov_len); }
+
+  // removes nbytes from the front, entries that are used up are dropped and the first remaining
+  // one is shortened
+  void consume(std::size_t nbytes) noexcept
+  {
+    CP_ASSERT(nbytes <= bytes_);
+    bytes_ -= nbytes;
+    while (first_ != last_ && nbytes >= data_[first_].iov_len)
+    {
+      nbytes -= data_[first_].iov_len;
+      ++first_;
+    }
+    if (first_ != last_)
+    {
+      data_[first_].iov_base = static_cast<char*>(data_[first_].iov_base) + nbytes;
+      data_[first_].iov_len -= nbytes;
+    }
+    else
+    {
+      first_ = last_ = 0;
+    }
+  }
+
+  void clear() noexcept
+  {
+    first_ = last_ = 0;
+    bytes_ = 0;
+  }
+
+  void reserve(std::size_t count)
+  {
+    if (count > capacity_ - first_) grow(count);
+  }
+
+  bool          empty()  const noexcept { return first_ == last_;  }
+  std::size_t   count()  const noexcept { return last_ - first_;   }
+  std::size_t   bytes()  const noexcept { return bytes_;           }
+  bool          is_inline() const noexcept { return data_ == inline_; }
+
+  ::iovec*       data()        noexcept { return data_ + first_; }
+  ::iovec const* data()  const noexcept { return data_ + first_; }
+
+  ::iovec*       begin()       noexcept { return data_ + first_; }
+  ::iovec*       end()         noexcept { return data_ + last_;  }
+  ::iovec const* begin() const noexcept { return data_ + first_; }
+  ::iovec const* end()   const noexcept { return data_ + last_;  }
+
+  ::iovec const& operator [] (std::size_t i) const noexcept { CP_ASSERT(i < count()); return data_[first_ + i]; }
+
+  // number of entries given to a single readv or writev call
+  int iovcnt() const noexcept { return int(std::min<std::size_t>(count(), std::size_t(::cp::max_iovec_count))); }
+
+private:
+  void emplace_back(void* data, std::size_t size)
+  {
+    if (last_ == capacity_) grow(count() + 1);
+    data_[last_].iov_base = data;
+    data_[last_].iov_len  = size;
+    ++last_;
+    bytes_ += size;
+  }
+
+  void emplace_front(void* data, std::size_t size)
+  {
+    if (0 == first_)
+    {
+      // entries are shifted right, leaving room in front for the next prepends as well
+      const std::size_t n    = count();
+      const std::size_t room = std::max<std::size_t>(1, std::min<std::size_t>(n, 8));
+      if (n + room > capacity_) grow(n + room, room);
+      else
+      {
+        std::memmove(data_ + room, data_, n * sizeof(::iovec));
+        first_ = room;
+        last_  = room + n;
+      }
+    }
+    --first_;
+    data_[first_].iov_base = data;
+    data_[first_].iov_len  = size;
+    bytes_ += size;
+  }
+
+  // moves entries to a heap array that holds at least count entries after front free slots
+  void grow(std::size_t count, std::size_t front = 0)
+  {
+    const std::size_t n        = this->count();
+    const std::size_t capacity = std::max(front + count, capacity_ * 2);
+    std::unique_ptr<::iovec[]> heap(new ::iovec[capacity]);
+    std::copy(data_ + first_, data_ + last_, heap.get() + front);
+    heap_     = std::move(heap);
+    data_     = heap_.get();
+    capacity_ = capacity;
+    first_    = front;
+    last_     = front + n;
+  }
+
+  void take(basic_buffer_chain& other) noexcept
+  {
+    if (other.is_inline())
+    {
+      std::copy(other.begin(), other.end(), inline_);
+      first_ = 0;
+      last_  = other.count();
+    }
+    else
+    {
+      heap_     = std::move(other.heap_);
+      data_     = heap_.get();
+      capacity_ = other.capacity_;
+      first_    = other.first_;
+      last_     = other.last_;
+      other.data_     = other.inline_;
+      other.capacity_ = InlineCapacity;
+    }
+    bytes_ = other.bytes_;
+    other.clear();
+  }
+
+  ::iovec                    inline_[InlineCapacity];
+  ::iovec*                   data_     = inline_;
+  std::unique_ptr<::iovec[]> heap_;
+  std::size_t                capacity_ = InlineCapacity;
+  std::size_t                first_    = 0;
+  std::size_t                last_     = 0;
+  std::size_t                bytes_    = 0;
+};
+
+// enough for header, payload and trailer writes without allocation
+using buffer_chain = basic_buffer_chain<16>;
+
+// vectored i/o over a chain, at most max_iovec_count entries are passed to one call so the
+// result can be short when the chain is longer. the chain is not modified
+
+template <std::size_t N>
+CP_FORCE_INLINE
+::ssize_t readv(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N> const& chain, std::error_code& ec) noexcept
+{
+  return ::cp::readv(fd, chain.data(), chain.iovcnt(), ec);
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE
+::ssize_t readv(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N> const& chain)
+{
+  return ::cp::readv(fd, chain.data(), chain.iovcnt());
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE
+::ssize_t writev(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N> const& chain, std::error_code& ec) noexcept
+{
+  return ::cp::writev(fd, chain.data(), chain.iovcnt(), ec);
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE
+::ssize_t writev(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N> const& chain)
+{
+  return ::cp::writev(fd, chain.data(), chain.iovcnt());
+}
+
+#if defined _DEFAULT_SOURCE
+template <std::size_t N>
+CP_FORCE_INLINE
+::ssize_t preadv(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N> const& chain, ::off_t offset, std::error_code& ec) noexcept
+{
+  return ::cp::preadv(fd, chain.data(), chain.iovcnt(), offset, ec);
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE
+::ssize_t preadv(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N> const& chain, ::off_t offset)
+{
+  return ::cp::preadv(fd, chain.data(), chain.iovcnt(), offset);
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE
+::ssize_t pwritev(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N> const& chain, ::off_t offset, std::error_code& ec) noexcept
+{
+  return ::cp::pwritev(fd, chain.data(), chain.iovcnt(), offset, ec);
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE
+::ssize_t pwritev(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N> const& chain, ::off_t offset)
+{
+  return ::cp::pwritev(fd, chain.data(), chain.iovcnt(), offset);
+}
+#endif
+
+// full transfer over a chain, it is consumed as bytes are transferred and after return it
+// describes the part that was not transferred. chains longer than max_iovec_count are
+// transferred in several calls
+
+template <std::size_t N>
+CP_FORCE_INLINE std::size_t
+readv_exact(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N>& chain, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+
+  std::size_t done = 0;
+  while (!chain.empty())
+  {
+    const ::ssize_t result = ::cp::readv(fd, chain, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      if (ec != std::errc::interrupted) break;
+      ec.clear();
+      continue;
+    }
+    if (0 == result) break;
+    done += result;
+    chain.consume(std::size_t(result));
+  }
+  return done;
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE std::size_t
+readv_exact(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N>& chain)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::readv_exact(fd, chain, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "readv_exact fd: [", fd, "], chain bytes: [", chain.bytes() + result, "], transferred: [", result, "]");
+  }
+  return result;
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE std::size_t
+writev_all(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N>& chain, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+
+  std::size_t done = 0;
+  while (!chain.empty())
+  {
+    const ::ssize_t result = ::cp::writev(fd, chain, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      if (ec != std::errc::interrupted) break;
+      ec.clear();
+      continue;
+    }
+    done += result;
+    chain.consume(std::size_t(result));
+  }
+  return done;
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE std::size_t
+writev_all(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N>& chain)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::writev_all(fd, chain, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "writev_all fd: [", fd, "], chain bytes: [", chain.bytes() + result, "], transferred: [", result, "]");
+  }
+  return result;
+}
+
+#if defined _DEFAULT_SOURCE
+
+template <std::size_t N>
+CP_FORCE_INLINE std::size_t
+preadv_exact(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N>& chain, ::off_t offset, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+  CP_ASSERT(offset >= 0);
+
+  std::size_t done = 0;
+  while (!chain.empty())
+  {
+    const ::ssize_t result = ::cp::preadv(fd, chain, offset + ::off_t(done), ec);
+    if (CP_UNLIKELY(ec))
+    {
+      if (ec != std::errc::interrupted) break;
+      ec.clear();
+      continue;
+    }
+    if (0 == result) break;
+    done += result;
+    chain.consume(std::size_t(result));
+  }
+  return done;
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE std::size_t
+preadv_exact(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N>& chain, ::off_t offset)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::preadv_exact(fd, chain, offset, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "preadv_exact fd: [", fd, "], chain bytes: [", chain.bytes() + result, "], offset: [", offset, "], transferred: [", result, "]");
+  }
+  return result;
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE std::size_t
+pwritev_all(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N>& chain, ::off_t offset, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+  CP_ASSERT(offset >= 0);
+
+  std::size_t done = 0;
+  while (!chain.empty())
+  {
+    const ::ssize_t result = ::cp::pwritev(fd, chain, offset + ::off_t(done), ec);
+    if (CP_UNLIKELY(ec))
+    {
+      if (ec != std::errc::interrupted) break;
+      ec.clear();
+      continue;
+    }
+    done += result;
+    chain.consume(std::size_t(result));
+  }
+  return done;
+}
+
+template <std::size_t N>
+CP_FORCE_INLINE std::size_t
+pwritev_all(::cp::file_descriptor const& fd, ::cp::basic_buffer_chain<N>& chain, ::off_t offset)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::pwritev_all(fd, chain, offset, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "pwritev_all fd: [", fd, "], chain bytes: [", chain.bytes() + result, "], offset: [", offset, "], transferred: [", result, "]");
+  }
+  return result;
+}
+#endif
+
+} // namespace cp
@@ -0,0 +1,528 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cp {
+
+class io_buffer_pool;
+
+// memory used by buffered_reader and buffered_writer. it is owned, borrowed from the caller or
+// taken from io_buffer_pool, pooled buffers go back to the pool when destroyed
+class io_buffer
+{
+  io_buffer(io_buffer const&) = delete;
+  io_buffer& operator = (io_buffer const&) = delete;
+
+public:
+  io_buffer() noexcept = default;
+
+  explicit io_buffer(std::size_t size)
+    : owned_(new char[size])
+    , data_(owned_.get())
+    , size_(size)
+  { }
+
+  // caller provided memory, it must outlive the buffer
+  io_buffer(void* data, std::size_t size) noexcept
+    : data_(static_cast<char*>(data))
+    , size_(size)
+  {
+    CP_ASSERT(data || 0 == size);
+  }
+
+  io_buffer(io_buffer&& other) noexcept
+    : owned_(std::move(other.owned_))
+    , data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+    , pool_(std::exchange(other.pool_, nullptr))
+  { }
+
+  io_buffer& operator = (io_buffer&& other) noexcept
+  {
+    if (this != &other)
+    {
+      release();
+      owned_ = std::move(other.owned_);
+      data_  = std::exchange(other.data_, nullptr);
+      size_  = std::exchange(other.size_, 0);
+      pool_  = std::exchange(other.pool_, nullptr);
+    }
+    return *this;
+  }
+
+  ~io_buffer() { release(); }
+
+  char*       data() const noexcept { return data_; }
+  std::size_t size() const noexcept { return size_; }
+
+  explicit operator bool() const noexcept { return 0 != size_; }
+
+private:
+  friend class io_buffer_pool;
+
+  inline void release() noexcept;
+
+  std::unique_ptr<char[]> owned_;
+  char*                   data_ = nullptr;
+  std::size_t             size_ = 0;
+  io_buffer_pool*         pool_ = nullptr;
+};
+
+// thread safe cache of equally sized buffers, so that short lived readers and writers do not
+// allocate. the pool must outlive buffers taken from it
+class io_buffer_pool
+{
+  io_buffer_pool(io_buffer_pool const&) = delete;
+  io_buffer_pool& operator = (io_buffer_pool const&) = delete;
+
+public:
+  explicit io_buffer_pool(std::size_t buffer_size, std::size_t max_cached = 16)
+    : buffer_size_(buffer_size)
+    , max_cached_(max_cached)
+  {
+    CP_ASSERT(buffer_size > 0);
+  }
+
+  io_buffer acquire()
+  {
+    std::unique_ptr<char[]> memory;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!cached_.empty())
+      {
+        memory = std::move(cached_.back());
+        cached_.pop_back();
+      }
+    }
+    if (!memory) memory.reset(new char[buffer_size_]);
+
+    io_buffer result;
+    result.data_  = memory.get();
+    result.size_  = buffer_size_;
+    result.owned_ = std::move(memory);
+    result.pool_  = this;
+    return result;
+  }
+
+  std::size_t buffer_size() const noexcept { return buffer_size_; }
+
+private:
+  friend class io_buffer;
+
+  void give_back(std::unique_ptr<char[]> memory) noexcept
+  {
+    try
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (cached_.size() < max_cached_) cached_.push_back(std::move(memory));
+    }
+    catch (...)
+    {
+      // memory is freed instead of cached
+    }
+  }
+
+  std::size_t const                     buffer_size_;
+  std::size_t const                     max_cached_;
+  std::mutex                            mutex_;
+  std::vector<std::unique_ptr<char[]>>  cached_;
+};
+
+inline void io_buffer::release() noexcept
+{
+  if (pool_ && owned_) pool_->give_back(std::move(owned_));
+  owned_.reset();
+  data_ = nullptr;
+  size_ = 0;
+  pool_ = nullptr;
+}
+
+// size used when buffer is not given, it is rounded up to a multiple of the file system block size
+constexpr std::size_t default_io_buffer_size = 64 * 1024;
+
+// requested size rounded up to a multiple of block size of the file system fd is on, requested
+// size is returned unchanged when block size can not be found
+inline
+std::size_t block_aligned_buffer_size(::cp::file_descriptor const& fd, std::size_t requested = ::cp::default_io_buffer_size) noexcept
+{
+  CP_ASSERT(fd);
+
+  ::cp::file_info info;
+  std::error_code ec;
+  ::cp::fstat(fd, info, ec);
+  if (ec || info.filesystem_block_size() <= 0) return requested;
+
+  const std::size_t block = std::size_t(info.filesystem_block_size());
+  return std::max(block, (requested + block - 1) / block * block);
+}
+
+// reads fd through a buffer, so that many small reads cost one read call. fd is not owned and
+// must outlive the reader. nothing is locked, one reader belongs to one thread
+class buffered_reader
+{
+  buffered_reader(buffered_reader const&) = delete;
+  buffered_reader& operator = (buffered_reader const&) = delete;
+
+public:
+  buffered_reader(::cp::file_descriptor const& fd, ::cp::io_buffer buffer) noexcept
+    : fd_(&fd)
+    , buffer_(std::move(buffer))
+  {
+    CP_ASSERT(fd);
+    CP_ASSERT(buffer_);
+  }
+
+  // buffer sized by block_aligned_buffer_size
+  explicit buffered_reader(::cp::file_descriptor const& fd)
+    : buffered_reader(fd, ::cp::io_buffer(::cp::block_aligned_buffer_size(fd)))
+  { }
+
+  buffered_reader(buffered_reader&&) noexcept = default;
+
+  // reads up to nbytes, less only on end of file or error. reads larger than the buffer go
+  // directly to the caller's memory
+  std::size_t read(void* data, std::size_t nbytes, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(data || 0 == nbytes);
+
+    char* out = static_cast<char*>(data);
+    std::size_t done = take(out, nbytes);
+    if (done == nbytes || eof_) return done;
+
+    if (nbytes - done >= buffer_.size())
+    {
+      const std::size_t direct = ::cp::read_exact(*fd_, out + done, nbytes - done, ec);
+      if (!ec && direct < nbytes - done) eof_ = true;
+      return done + direct;
+    }
+
+    while (done < nbytes && fill(ec))
+    {
+      done += take(out + done, nbytes - done);
+    }
+    return done;
+  }
+
+  std::size_t read(void* data, std::size_t nbytes)
+  {
+    std::error_code ec;
+    const std::size_t result = read(data, nbytes, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "buffered_reader::read fd: [", *fd_, "], nbytes: [", nbytes, "], transferred: [", result, "]");
+    }
+    return result;
+  }
+
+  // next record ending with delim, record does not include delim and points into the buffer, it
+  // stays valid until the next call. last record of the file may have no delim. returns false
+  // at end of file. a record that does not fit into the buffer fails with value_too_large and
+  // stays buffered, it can then be read with the std::string overload
+  bool read_until(char delim, std::string_view& record, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    std::size_t scanned = 0;
+    for (;;)
+    {
+      const char* const first = buffer_.data() + begin_;
+      const char* const found = static_cast<const char*>(std::memchr(first + scanned, delim, end_ - begin_ - scanned));
+      if (found)
+      {
+        record = std::string_view(first, std::size_t(found - first));
+        begin_ += record.size() + 1;
+        return true;
+      }
+
+      scanned = end_ - begin_;
+      if (CP_UNLIKELY(scanned == buffer_.size()))
+      {
+        ec = std::make_error_code(std::errc::value_too_large);
+        return false;
+      }
+      if (eof_ || !fill(ec))
+      {
+        if (ec || begin_ == end_) return false;
+        record = std::string_view(buffer_.data() + begin_, end_ - begin_);
+        begin_ = end_;
+        return true;
+      }
+    }
+  }
+
+  bool read_until(char delim, std::string_view& record)
+  {
+    std::error_code ec;
+    const bool result = read_until(delim, record, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "buffered_reader::read_until fd: [", *fd_, "], buffer size: [", buffer_.size(), "]");
+    }
+    return result;
+  }
+
+  // same as above, record is copied into line so it can be of any length
+  bool read_until(char delim, std::string& line, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    line.clear();
+    bool any = false;
+    for (;;)
+    {
+      const char* const first = buffer_.data() + begin_;
+      const char* const found = static_cast<const char*>(std::memchr(first, delim, end_ - begin_));
+      if (found)
+      {
+        line.append(first, found);
+        begin_ += std::size_t(found - first) + 1;
+        return true;
+      }
+
+      any = any || begin_ != end_;
+      line.append(first, end_ - begin_);
+      begin_ = end_;
+      if (eof_ || !fill(ec)) return !ec && any;
+    }
+  }
+
+  bool read_until(char delim, std::string& line)
+  {
+    std::error_code ec;
+    const bool result = read_until(delim, line, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "buffered_reader::read_until fd: [", *fd_, "]");
+    }
+    return result;
+  }
+
+  bool read_line(std::string_view& line, std::error_code& ec) noexcept { return read_until('\n', line, ec); }
+  bool read_line(std::string_view& line)                               { return read_until('\n', line);     }
+  bool read_line(std::string& line, std::error_code& ec)               { return read_until('\n', line, ec); }
+  bool read_line(std::string& line)                                    { return read_until('\n', line);     }
+
+  // bytes read from fd and not yet returned
+  std::string_view buffered() const noexcept { return std::string_view(buffer_.data() + begin_, end_ - begin_); }
+
+  bool        eof()         const noexcept { return eof_ && begin_ == end_; }
+  std::size_t buffer_size() const noexcept { return buffer_.size(); }
+
+private:
+  std::size_t take(char* out, std::size_t nbytes) noexcept
+  {
+    const std::size_t n = std::min(nbytes, end_ - begin_);
+    if (n) std::memcpy(out, buffer_.data() + begin_, n);
+    begin_ += n;
+    return n;
+  }
+
+  // moves unread bytes to the front and reads more after them, returns false on end of file,
+  // error or full buffer
+  bool fill(std::error_code& ec) noexcept
+  {
+    if (begin_ != 0)
+    {
+      std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+      end_ -= begin_;
+      begin_ = 0;
+    }
+    if (end_ == buffer_.size()) return false;
+
+    for (;;)
+    {
+      const ::ssize_t result = ::read(*fd_, buffer_.data() + end_, buffer_.size() - end_);
+      if (CP_UNLIKELY(-1 == result))
+      {
+        if (EINTR == errno) continue;
+        ec = ::cp::make_system_error_code();
+        return false;
+      }
+      if (0 == result)
+      {
+        eof_ = true;
+        return false;
+      }
+      end_ += std::size_t(result);
+      return true;
+    }
+  }
+
+  ::cp::file_descriptor const* fd_;
+  ::cp::io_buffer              buffer_;
+  std::size_t                  begin_ = 0;
+  std::size_t                  end_   = 0;
+  bool                         eof_   = false;
+};
+
+// writes to fd through a buffer, data is written once flush_threshold bytes are buffered. data
+// that does not fit is written together with the buffer in one writev. the destructor flushes
+// and ignores errors, call flush to see them. fd is not owned and must outlive the writer,
+// nothing is locked
+class buffered_writer
+{
+  buffered_writer(buffered_writer const&) = delete;
+  buffered_writer& operator = (buffered_writer const&) = delete;
+
+public:
+  // flush_threshold 0 means full buffer
+  buffered_writer(::cp::file_descriptor const& fd, ::cp::io_buffer buffer, std::size_t flush_threshold = 0) noexcept
+    : fd_(&fd)
+    , buffer_(std::move(buffer))
+    , threshold_(0 == flush_threshold ? buffer_.size() : flush_threshold)
+  {
+    CP_ASSERT(fd);
+    CP_ASSERT(buffer_);
+    CP_ASSERT(threshold_ <= buffer_.size());
+  }
+
+  // buffer sized by block_aligned_buffer_size
+  explicit buffered_writer(::cp::file_descriptor const& fd)
+    : buffered_writer(fd, ::cp::io_buffer(::cp::block_aligned_buffer_size(fd)))
+  { }
+
+  buffered_writer(buffered_writer&& other) noexcept
+    : fd_(other.fd_)
+    , buffer_(std::move(other.buffer_))
+    , threshold_(other.threshold_)
+    , used_(std::exchange(other.used_, 0))
+  { }
+
+  ~buffered_writer()
+  {
+    if (used_)
+    {
+      std::error_code ec;
+      flush(ec);
+    }
+  }
+
+  // returns number of bytes accepted, less than nbytes only on error. on error the buffer keeps
+  // the bytes that were not written
+  std::size_t write(const void* data, std::size_t nbytes, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(data || 0 == nbytes);
+
+    if (nbytes <= buffer_.size() - used_)
+    {
+      std::memcpy(buffer_.data() + used_, data, nbytes);
+      used_ += nbytes;
+      if (used_ >= threshold_) flush(ec);
+      return nbytes;
+    }
+
+    ::iovec iov[2] = { { buffer_.data(), used_ }, { const_cast<void*>(data), nbytes } };
+    const std::size_t buffered = used_;
+    const std::size_t written  = ::cp::writev_all(*fd_, iov, 2, ec);
+    if (CP_LIKELY(!ec))
+    {
+      used_ = 0;
+      return nbytes;
+    }
+
+    if (written < buffered)
+    {
+      // part of the buffer was written, the rest of it moves to the front
+      std::memmove(buffer_.data(), buffer_.data() + written, buffered - written);
+      used_ = buffered - written;
+      return 0;
+    }
+    used_ = 0;
+    return written - buffered;
+  }
+
+  std::size_t write(const void* data, std::size_t nbytes)
+  {
+    std::error_code ec;
+    const std::size_t result = write(data, nbytes, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "buffered_writer::write fd: [", *fd_, "], nbytes: [", nbytes, "], accepted: [", result, "]");
+    }
+    return result;
+  }
+
+  std::size_t write(std::string_view s, std::error_code& ec) noexcept { return write(s.data(), s.size(), ec); }
+  std::size_t write(std::string_view s)                               { return write(s.data(), s.size());     }
+
+  void put(char c, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    if (CP_UNLIKELY(used_ == buffer_.size()))
+    {
+      flush(ec);
+      if (ec) return;
+    }
+    buffer_.data()[used_++] = c;
+    if (used_ >= threshold_) flush(ec);
+  }
+
+  void put(char c)
+  {
+    std::error_code ec;
+    put(c, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "buffered_writer::put fd: [", *fd_, "]");
+    }
+  }
+
+  // writes everything buffered, on error the bytes that were not written stay buffered
+  void flush(std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    const std::size_t written = ::cp::write_all(*fd_, buffer_.data(), used_, ec);
+    if (CP_UNLIKELY(written != used_))
+    {
+      std::memmove(buffer_.data(), buffer_.data() + written, used_ - written);
+    }
+    used_ -= written;
+  }
+
+  void flush()
+  {
+    std::error_code ec;
+    flush(ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "buffered_writer::flush fd: [", *fd_, "], buffered: [", used_, "]");
+    }
+  }
+
+  std::size_t buffered()        const noexcept { return used_;           }
+  std::size_t buffer_size()     const noexcept { return buffer_.size();  }
+  std::size_t flush_threshold() const noexcept { return threshold_;      }
+
+private:
+  ::cp::file_descriptor const* fd_;
+  ::cp::io_buffer              buffer_;
+  std::size_t                  threshold_;
+  std::size_t                  used_ = 0;
+};
+
+} // namespace cp
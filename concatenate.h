@@ -6,33 +6,135 @@
 //          https://www.boost.org/LICENSE_1_0.txt)
 
 
+#include "config.h"
 #include "basic_to_string.h"
+#include <charconv>
+#include <cstring>
+#include <limits>
 #include <string>
+#include <string_view>
 #include <type_traits>
 
 
 namespace cp
 {
-  // this is totally idiotic implementation should be replaced with something with expression templates 
-  // that minimizes number of allocation, but at the this time this is something that should enable me to 
-  // provide interface for cp::concat function and move on ... 
+  // concat is used on the throw path of every wrapper, so it is done in two passes: every argument is
+  // first turned into a piece that knows its exact length (strings are only referenced, everything
+  // else is written into a stack buffer with serialization_traits<T>::to_chars), then the result is
+  // reserved once and the pieces are appended to it. Types whose serialization_traits only provide
+  // to_string still work, at the cost of a temporary string.
 
-  std::string concat_impl( ) { return ""; }
+namespace detail
+{
+  // types that only provide to_string in their serialization_traits
+  template <typename T, typename = void>
+  struct concat_piece
+  {
+    explicit concat_piece(T const& value) : str_(::cp::serialization_traits<T>::to_string(value)) { }
+
+    const char* data() const noexcept { return str_.data(); }
+    std::size_t size() const noexcept { return str_.size(); }
+
+  private:
+    std::string str_;
+  };
+
+  template <>
+  struct concat_piece<std::string_view>
+  {
+    explicit concat_piece(std::string_view value) noexcept : data_(value.data()), size_(value.size()) { }
+
+    const char* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+
+  private:
+    const char* data_;
+    std::size_t size_;
+  };
+
+  template <>
+  struct concat_piece<std::string> : concat_piece<std::string_view>
+  {
+    using concat_piece<std::string_view>::concat_piece;
+  };
+
+  template <>
+  struct concat_piece<const char*>
+  {
+    explicit concat_piece(const char* value) noexcept
+      : data_(value ? value : "nullptr")
+      , size_(std::strlen(data_))
+    { }
+
+    const char* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+
+  private:
+    const char* data_;
+    std::size_t size_;
+  };
+
+  template <>
+  struct concat_piece<char*> : concat_piece<const char*>
+  {
+    using concat_piece<const char*>::concat_piece;
+  };
+
+  template <typename T>
+  struct concat_piece<T, std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value>>
+  {
+    explicit concat_piece(T value) noexcept
+      : size_(std::to_chars(buffer_, buffer_ + sizeof(buffer_), value).ptr - buffer_)
+    { }
+
+    const char* data() const noexcept { return buffer_; }
+    std::size_t size() const noexcept { return size_; }
+
+  private:
+    char        buffer_[std::numeric_limits<T>::digits10 + 3];
+    std::size_t size_;
+  };
+
+  template <typename T>
+  struct concat_piece<T, std::enable_if_t<!std::is_integral<T>::value && has_to_chars<T>::value>>
+  {
+    // values that do not fit the stack buffer (huge floats in fixed notation) are rare enough
+    // to go through to_string
+    explicit concat_piece(T const& value)
+    {
+      const std::to_chars_result result = ::cp::serialization_traits<T>::to_chars(buffer_, buffer_ + sizeof(buffer_), value);
+      if (CP_LIKELY(result.ec == std::errc())) {
+        size_ = result.ptr - buffer_;
+      } else {
+        str_  = ::cp::serialization_traits<T>::to_string(value);
+        size_ = str_.size();
+      }
+    }
+
+    const char* data() const noexcept { return str_.empty() ? buffer_ : str_.data(); }
+    std::size_t size() const noexcept { return size_; }
 
-  template <typename... Tail >
-  std::string concat_impl(Tail const&... t);
+  private:
+    char        buffer_[64];
+    std::size_t size_;
+    std::string str_;
+  };
 
-  template < typename Head, typename... Tail >
-  std::string concat_impl(Head const& h, Tail const&... t)
-  { 
-    return ::cp::serialization_traits<Head>::to_string(h) + concat_impl(t...);
+  template <typename... Pieces>
+  std::string concat_pieces(Pieces const&... pieces)
+  {
+    std::string result;
+    result.reserve((std::size_t(0) + ... + pieces.size()));
+    (result.append(pieces.data(), pieces.size()), ...);
+    return result;
   }
+} // namespace detail
 
 template <typename... Args>
 inline
 std::string concat(Args const&... args)
 {
-  return concat_impl(std::add_const_t<std::add_lvalue_reference_t<std::decay_t<Args>>>(args)... );
+  return ::cp::detail::concat_pieces(::cp::detail::concat_piece<std::decay_t<Args>>(args)...);
 }
 
 } // namespace cp
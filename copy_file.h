@@ -0,0 +1,418 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+#if defined(__linux__) && defined(_GNU_SOURCE)
+
+namespace cp {
+
+// how copy_file moved the data, strategies are tried in this order
+enum class copy_strategy
+{
+  none,             // source was empty
+  reflink,          // FICLONE or FICLONERANGE, destination shares extents with source
+  copy_file_range,  // in kernel copy, file system may offload it
+  sendfile,
+  splice,           // through a pipe
+  read_write        // through a user space buffer
+};
+
+inline const char* to_string(::cp::copy_strategy strategy) noexcept
+{
+  switch (strategy)
+  {
+    case ::cp::copy_strategy::none:            return "none";
+    case ::cp::copy_strategy::reflink:         return "reflink";
+    case ::cp::copy_strategy::copy_file_range: return "copy_file_range";
+    case ::cp::copy_strategy::sendfile:        return "sendfile";
+    case ::cp::copy_strategy::splice:          return "splice";
+    case ::cp::copy_strategy::read_write:      return "read_write";
+  }
+  return "unknown";
+}
+
+struct copy_options
+{
+  // strategies that may be tried, read_write is always allowed as the last one
+  bool        reflink         = true;
+  bool        copy_file_range = true;
+  bool        sendfile        = true;
+  bool        splice          = true;
+
+  // only data segments found with SEEK_DATA and SEEK_HOLE are copied, holes stay holes
+  bool        preserve_holes  = true;
+
+  // bytes moved by one call
+  std::size_t chunk_size      = 8 * 1024 * 1024;
+};
+
+struct copy_result
+{
+  std::uint64_t       bytes    = 0;                          // data bytes copied, holes excluded
+  ::cp::copy_strategy strategy = ::cp::copy_strategy::none;  // strategy that copied the last byte
+};
+
+namespace detail {
+  // errors that mean strategy can not be used for this pair of files, next one is tried
+  CP_FORCE_INLINE
+  bool is_copy_strategy_unsupported(int error) noexcept
+  {
+    return ENOSYS == error || EOPNOTSUPP == error || EINVAL == error || EXDEV == error || ENOTTY == error || EPERM == error || EBADF == error;
+  }
+
+#if defined FICLONERANGE
+  // clones data of [offset, offset + length) with FICLONERANGE. file systems want ranges in
+  // multiples of block, except one that ends at end of file, so the range is cut down and the rest
+  // is left to other strategies. returns cloned bytes, clear supported when reflink can not be used
+  CP_FORCE_INLINE
+  std::uint64_t clone_range(int src, int dst, ::off_t offset, std::uint64_t length, ::off_t size, std::uint64_t block, bool& supported, std::error_code& ec) noexcept
+  {
+    if (offset + ::off_t(length) != size) length -= length % block;
+    if (0 == length || 0 != std::uint64_t(offset) % block) return 0;
+
+    ::file_clone_range range{};
+    range.src_fd      = src;
+    range.src_offset  = std::uint64_t(offset);
+    range.src_length  = length;
+    range.dest_offset = std::uint64_t(offset);
+    if (0 == ::ioctl(dst, FICLONERANGE, &range)) return length;
+
+    if (::cp::detail::is_copy_strategy_unsupported(errno)) supported = false;
+    else ec = ::cp::make_system_error_code();
+    return 0;
+  }
+#endif
+
+  class file_copier
+  {
+  public:
+    file_copier(int src, int dst, ::cp::copy_options const& options) noexcept
+      : src_(src), dst_(dst), options_(options)
+    {
+      strategy_ = options.copy_file_range ? ::cp::copy_strategy::copy_file_range
+                : options.sendfile        ? ::cp::copy_strategy::sendfile
+                : options.splice          ? ::cp::copy_strategy::splice
+                :                           ::cp::copy_strategy::read_write;
+    }
+
+    // copies [offset, offset + length) to the same offset in destination, returns bytes copied,
+    // less than length when source got shorter
+    std::uint64_t copy_range(::off_t offset, std::uint64_t length, std::error_code& ec)
+    {
+      std::uint64_t done = 0;
+      while (done < length)
+      {
+        const std::size_t chunk = std::size_t(std::min<std::uint64_t>(length - done, options_.chunk_size));
+        const ::off_t     at    = offset + ::off_t(done);
+        ::ssize_t result;
+        switch (strategy_)
+        {
+          case ::cp::copy_strategy::copy_file_range: result = copy_with_copy_file_range(at, chunk); break;
+          case ::cp::copy_strategy::sendfile:        result = copy_with_sendfile(at, chunk);        break;
+          case ::cp::copy_strategy::splice:          result = copy_with_splice(at, chunk);          break;
+          default:                                   result = copy_with_read_write(at, chunk);      break;
+        }
+
+        if (CP_UNLIKELY(-1 == result))
+        {
+          const int error = errno;
+          if (EINTR == error) continue;
+          if (::cp::copy_strategy::read_write != strategy_ && !pending_ && ::cp::detail::is_copy_strategy_unsupported(error))
+          {
+            next_strategy();
+            continue;
+          }
+          ec = ::cp::make_system_error_code(error);
+          break;
+        }
+        if (0 == result) break;
+        done += std::uint64_t(result);
+        used_ = strategy_;
+      }
+      return done;
+    }
+
+    ::cp::copy_strategy used() const noexcept { return used_; }
+
+  private:
+    void next_strategy() noexcept
+    {
+      switch (strategy_)
+      {
+        case ::cp::copy_strategy::copy_file_range:
+          if (options_.sendfile) { strategy_ = ::cp::copy_strategy::sendfile; break; }
+          // fall through
+        case ::cp::copy_strategy::sendfile:
+          if (options_.splice) { strategy_ = ::cp::copy_strategy::splice; break; }
+          // fall through
+        default:
+          strategy_ = ::cp::copy_strategy::read_write;
+      }
+    }
+
+    ::ssize_t copy_with_copy_file_range(::off_t offset, std::size_t length) noexcept
+    {
+      ::off_t in = offset, out = offset;
+      return ::copy_file_range(src_, &in, dst_, &out, length, 0);
+    }
+
+    ::ssize_t copy_with_sendfile(::off_t offset, std::size_t length) noexcept
+    {
+      // sendfile writes at the file position of destination
+      if (-1 == ::lseek(dst_, offset, SEEK_SET)) return -1;
+      ::off_t in = offset;
+      return ::sendfile(dst_, src_, &in, length);
+    }
+
+    ::ssize_t copy_with_splice(::off_t offset, std::size_t length) noexcept
+    {
+      if (!pipe_[0])
+      {
+        int fds[2];
+        if (-1 == ::pipe2(fds, O_CLOEXEC)) return -1;
+        pipe_[0].reset(fds[0]);
+        pipe_[1].reset(fds[1]);
+        ::fcntl(fds[1], F_SETPIPE_SZ, int(std::min<std::size_t>(options_.chunk_size, 1024 * 1024)));
+      }
+
+      ::off_t in = offset;
+      const ::ssize_t filled = ::splice(src_, &in, pipe_[1], nullptr, length, SPLICE_F_MOVE);
+      if (filled <= 0) return filled;
+
+      // once data is in the pipe there is no way back to another strategy
+      pending_ = true;
+      ::off_t out = offset;
+      ::ssize_t drained = 0;
+      while (drained < filled)
+      {
+        const ::ssize_t result = ::splice(pipe_[0], nullptr, dst_, &out, std::size_t(filled - drained), SPLICE_F_MOVE);
+        if (-1 == result)
+        {
+          if (EINTR == errno) continue;
+          return -1;
+        }
+        drained += result;
+      }
+      pending_ = false;
+      return filled;
+    }
+
+    ::ssize_t copy_with_read_write(::off_t offset, std::size_t length) noexcept
+    {
+      if (!buffer_)
+      {
+        buffer_size_ = std::min<std::size_t>(options_.chunk_size, 1024 * 1024);
+        buffer_.reset(new (std::nothrow) char[buffer_size_]);
+        if (!buffer_)
+        {
+          errno = ENOMEM;
+          return -1;
+        }
+      }
+
+      const ::ssize_t filled = ::pread(src_, buffer_.get(), std::min(length, buffer_size_), offset);
+      if (filled <= 0) return filled;
+
+      ::ssize_t written = 0;
+      while (written < filled)
+      {
+        const ::ssize_t result = ::pwrite(dst_, buffer_.get() + written, std::size_t(filled - written), offset + written);
+        if (-1 == result)
+        {
+          if (EINTR == errno) continue;
+          return -1;
+        }
+        written += result;
+      }
+      return filled;
+    }
+
+    int                       src_;
+    int                       dst_;
+    ::cp::copy_options const& options_;
+    ::cp::copy_strategy       strategy_;
+    ::cp::copy_strategy       used_    = ::cp::copy_strategy::none;
+    bool                      pending_ = false;
+    ::cp::file_descriptor     pipe_[2];
+    std::unique_ptr<char[]>   buffer_;
+    std::size_t               buffer_size_ = 0;
+  };
+}
+
+// copies whole content of regular file src into dst, starting at offset 0 of both, and sets
+// size of dst to size of src. file positions are not used, except that sendfile moves the
+// position of dst. dst should be empty, bytes past the holes of src are left as they are
+inline
+::cp::copy_result copy_file(::cp::file_descriptor const& src, ::cp::file_descriptor const& dst, ::cp::copy_options const& options, std::error_code& ec)
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(src);
+  CP_ASSERT(dst);
+  CP_ASSERT(options.chunk_size > 0);
+
+  ::cp::copy_result result;
+
+  ::cp::file_info info;
+  ::cp::fstat(src, info, ec);
+  if (CP_UNLIKELY(ec)) return result;
+  CP_ASSERT(info.is_regular_file());
+  const ::off_t size = info.size();
+
+  // data segments are cloned one by one with FICLONERANGE when FICLONE of the whole file was
+  // refused only because of the files (EINVAL), not because the file system can not reflink
+  bool reflink_ranges = options.reflink && options.preserve_holes;
+#if defined FICLONE
+  if (options.reflink && size > 0)
+  {
+    if (0 == ::ioctl(dst, FICLONE, src.get()))
+    {
+      result.bytes    = std::uint64_t(size);
+      result.strategy = ::cp::copy_strategy::reflink;
+      return result;
+    }
+    if (!::cp::detail::is_copy_strategy_unsupported(errno))
+    {
+      ec = ::cp::make_system_error_code();
+      return result;
+    }
+    if (EINVAL != errno) reflink_ranges = false;
+  }
+#endif
+#if !defined FICLONERANGE
+  reflink_ranges = false;
+#endif
+#if defined FICLONERANGE
+  const std::uint64_t block = std::uint64_t(std::max<::blksize_t>(info.filesystem_block_size(), 1));
+#endif
+  bool cloned_last = false;
+
+  ::cp::detail::file_copier copier(src, dst, options);
+  bool sparse = options.preserve_holes;
+  for (::off_t offset = 0; offset < size; )
+  {
+    ::off_t data = offset, hole = size;
+    if (sparse)
+    {
+      std::error_code seek_ec;
+      data = ::cp::lseek(src, offset, SEEK_DATA, seek_ec);
+      if (!seek_ec) hole = ::cp::lseek(src, data, SEEK_HOLE, seek_ec);
+      if (seek_ec == std::errc::no_such_device_or_address)
+      {
+        // only a hole remains
+        break;
+      }
+      if (seek_ec)
+      {
+        // file system does not know about holes, everything is data
+        sparse = false;
+        data   = offset;
+        hole   = size;
+      }
+    }
+
+    std::uint64_t length = std::uint64_t(std::min(hole, size) - data);
+#if defined FICLONERANGE
+    if (reflink_ranges)
+    {
+      const std::uint64_t cloned = ::cp::detail::clone_range(src, dst, data, length, size, block, reflink_ranges, ec);
+      if (CP_UNLIKELY(ec)) break;
+      result.bytes += cloned;
+      data         += ::off_t(cloned);
+      length       -= cloned;
+      cloned_last   = 0 != cloned;
+    }
+#endif
+    if (0 != length)
+    {
+      const std::uint64_t copied = copier.copy_range(data, length, ec);
+      result.bytes += copied;
+      cloned_last   = false;
+      if (ec || copied < length) break;
+    }
+    offset = data + ::off_t(length);
+  }
+  result.strategy = cloned_last || (::cp::copy_strategy::none == copier.used() && 0 != result.bytes) ? ::cp::copy_strategy::reflink : copier.used();
+  if (CP_UNLIKELY(ec)) return result;
+
+  // trailing hole, and data past size when dst was not empty
+  ::cp::ftruncate(dst, size, ec);
+  return result;
+}
+
+inline
+::cp::copy_result copy_file(::cp::file_descriptor const& src, ::cp::file_descriptor const& dst, std::error_code& ec)
+{
+  return ::cp::copy_file(src, dst, ::cp::copy_options(), ec);
+}
+
+inline
+::cp::copy_result copy_file(::cp::file_descriptor const& src, ::cp::file_descriptor const& dst, ::cp::copy_options const& options = ::cp::copy_options())
+{
+  std::error_code ec;
+  const ::cp::copy_result result = ::cp::copy_file(src, dst, options, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "copy_file src: [", src, "], dst: [", dst, "], strategy: [", ::cp::to_string(result.strategy), "], copied: [", result.bytes, "]");
+  }
+  return result;
+}
+
+// creates or truncates to and copies from into it, permission bits of from are given to open
+inline
+::cp::copy_result copy_file(const char* from, const char* to, ::cp::copy_options const& options, std::error_code& ec)
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(from);
+  CP_ASSERT(to);
+
+  const ::cp::file_descriptor src = ::cp::open(from, O_RDONLY | O_CLOEXEC, ec);
+  if (CP_UNLIKELY(ec)) return ::cp::copy_result();
+
+  ::cp::file_info info;
+  ::cp::fstat(src, info, ec);
+  if (CP_UNLIKELY(ec)) return ::cp::copy_result();
+
+  const ::cp::file_descriptor dst = ::cp::open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, info.mode() & 07777, ec);
+  if (CP_UNLIKELY(ec)) return ::cp::copy_result();
+
+  return ::cp::copy_file(src, dst, options, ec);
+}
+
+inline
+::cp::copy_result copy_file(const char* from, const char* to, std::error_code& ec)
+{
+  return ::cp::copy_file(from, to, ::cp::copy_options(), ec);
+}
+
+inline
+::cp::copy_result copy_file(const char* from, const char* to, ::cp::copy_options const& options = ::cp::copy_options())
+{
+  std::error_code ec;
+  const ::cp::copy_result result = ::cp::copy_file(from, to, options, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "copy_file from: [", from, "], to: [", to, "], strategy: [", ::cp::to_string(result.strategy), "], copied: [", result.bytes, "]");
+  }
+  return result;
+}
+
+} // namespace cp
+
+#endif
@@ -0,0 +1,342 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+#include "util.h"
+
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__) && defined(O_DIRECT)
+
+namespace cp {
+
+// alignment O_DIRECT transfers need, buffer addresses must be multiple of memory and file
+// offsets and lengths multiple of offset
+struct direct_io_alignment
+{
+  std::size_t memory = 0;
+  std::size_t offset = 0;
+};
+
+// asks statx for STATX_DIOALIGN when kernel knows it, block devices are asked for logical
+// sector size with BLKSSZGET and other files fall back to file system block size, which is a
+// multiple of the sector size. fails with EINVAL when file system reports that direct i/o is
+// not supported
+inline
+::cp::direct_io_alignment probe_direct_io_alignment(::cp::file_descriptor const& fd, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+
+  ::cp::direct_io_alignment result;
+
+#if defined(STATX_DIOALIGN) && defined(_LINUX_STAT_H)
+  ::cp::extended_file_info xinfo{};
+  ::cp::statx(fd, AT_STATX_DONT_SYNC, STATX_TYPE | STATX_DIOALIGN, xinfo, ec);
+  if (CP_UNLIKELY(ec)) return result;
+  if (xinfo.has(STATX_DIOALIGN))
+  {
+    if (0 == xinfo.dio_memory_alignment() || 0 == xinfo.dio_offset_alignment())
+    {
+      ec = std::make_error_code(std::errc::invalid_argument);
+      return result;
+    }
+    result.memory = xinfo.dio_memory_alignment();
+    result.offset = xinfo.dio_offset_alignment();
+    return result;
+  }
+#endif
+
+  ::cp::file_info info;
+  ::cp::fstat(fd, info, ec);
+  if (CP_UNLIKELY(ec)) return result;
+
+  if (info.is_block_device())
+  {
+    int sector_size = 0;
+    if (CP_UNLIKELY(-1 == ::ioctl(fd, BLKSSZGET, &sector_size)))
+    {
+      ec = ::cp::make_system_error_code();
+      return result;
+    }
+    result.memory = result.offset = std::size_t(sector_size);
+    return result;
+  }
+
+  result.memory = result.offset = std::size_t(std::max<::blksize_t>(info.filesystem_block_size(), 512));
+  return result;
+}
+
+inline
+::cp::direct_io_alignment probe_direct_io_alignment(::cp::file_descriptor const& fd)
+{
+  std::error_code ec;
+  const ::cp::direct_io_alignment result = ::cp::probe_direct_io_alignment(fd, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "probe_direct_io_alignment fd: [", fd, "]");
+  }
+  return result;
+}
+
+class aligned_buffer_pool;
+
+// memory aligned for direct i/o, pooled buffers go back to the pool when destroyed
+class aligned_buffer
+{
+  aligned_buffer(aligned_buffer const&) = delete;
+  aligned_buffer& operator = (aligned_buffer const&) = delete;
+
+public:
+  aligned_buffer() noexcept = default;
+
+  // throws std::bad_alloc
+  aligned_buffer(std::size_t alignment, std::size_t size)
+    : memory_(::cp::aligned_malloc(std::max(alignment, sizeof(void*)), size))
+    , size_(size)
+  {
+    if (!memory_) throw std::bad_alloc();
+  }
+
+  aligned_buffer(aligned_buffer&& other) noexcept
+    : memory_(std::move(other.memory_))
+    , size_(std::exchange(other.size_, 0))
+    , pool_(std::exchange(other.pool_, nullptr))
+  { }
+
+  aligned_buffer& operator = (aligned_buffer&& other) noexcept
+  {
+    if (this != &other)
+    {
+      release();
+      memory_ = std::move(other.memory_);
+      size_   = std::exchange(other.size_, 0);
+      pool_   = std::exchange(other.pool_, nullptr);
+    }
+    return *this;
+  }
+
+  ~aligned_buffer() { release(); }
+
+  char*       data() const noexcept { return static_cast<char*>(memory_.get()); }
+  std::size_t size() const noexcept { return size_; }
+
+  explicit operator bool() const noexcept { return bool(memory_); }
+
+private:
+  friend class aligned_buffer_pool;
+
+  inline void release() noexcept;
+
+  ::cp::unique_malloc_ptr<void> memory_;
+  std::size_t                   size_ = 0;
+  aligned_buffer_pool*          pool_ = nullptr;
+};
+
+// thread safe cache of equally sized aligned buffers, the pool must outlive buffers taken from it
+class aligned_buffer_pool
+{
+  aligned_buffer_pool(aligned_buffer_pool const&) = delete;
+  aligned_buffer_pool& operator = (aligned_buffer_pool const&) = delete;
+
+public:
+  // buffer_size is rounded up to a multiple of alignment
+  aligned_buffer_pool(std::size_t alignment, std::size_t buffer_size, std::size_t max_cached = 16)
+    : alignment_(std::max(alignment, sizeof(void*)))
+    , buffer_size_((buffer_size + alignment_ - 1) / alignment_ * alignment_)
+    , max_cached_(max_cached)
+  {
+    CP_ASSERT(0 == (alignment_ & (alignment_ - 1)));
+    CP_ASSERT(buffer_size > 0);
+  }
+
+  // buffers for direct i/o on a file opened with that alignment
+  aligned_buffer_pool(::cp::direct_io_alignment alignment, std::size_t buffer_size, std::size_t max_cached = 16)
+    : aligned_buffer_pool(std::max(alignment.memory, alignment.offset), buffer_size, max_cached)
+  { }
+
+  // throws std::bad_alloc
+  aligned_buffer acquire()
+  {
+    aligned_buffer result;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!cached_.empty())
+      {
+        result.memory_ = std::move(cached_.back());
+        cached_.pop_back();
+      }
+    }
+    if (!result.memory_)
+    {
+      result.memory_ = ::cp::aligned_malloc(alignment_, buffer_size_);
+      if (!result.memory_) throw std::bad_alloc();
+    }
+    result.size_ = buffer_size_;
+    result.pool_ = this;
+    return result;
+  }
+
+  std::size_t alignment()   const noexcept { return alignment_;   }
+  std::size_t buffer_size() const noexcept { return buffer_size_; }
+
+private:
+  friend class aligned_buffer;
+
+  void give_back(::cp::unique_malloc_ptr<void> memory) noexcept
+  {
+    try
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (cached_.size() < max_cached_) cached_.push_back(std::move(memory));
+    }
+    catch (...)
+    {
+      // memory is freed instead of cached
+    }
+  }
+
+  std::size_t const                          alignment_;
+  std::size_t const                          buffer_size_;
+  std::size_t const                          max_cached_;
+  std::mutex                                 mutex_;
+  std::vector<::cp::unique_malloc_ptr<void>> cached_;
+};
+
+inline void aligned_buffer::release() noexcept
+{
+  if (pool_ && memory_) pool_->give_back(std::move(memory_));
+  memory_.reset();
+  size_ = 0;
+  pool_ = nullptr;
+}
+
+// file opened twice, with O_DIRECT for aligned transfers that bypass page cache and without it
+// for the unaligned tail of a transfer. buffers and offsets given to pread and pwrite must be
+// aligned, which is checked with CP_ASSERT, only the length may be unaligned. the part of the
+// length below offset alignment goes through O_DIRECT and the rest through page cache
+class direct_file
+{
+public:
+  // flags are open flags without O_DIRECT, O_CREAT, O_EXCL and O_TRUNC apply to the first open
+  direct_file(const char* pathname, int flags, ::mode_t mode, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    open(pathname, flags, mode, ec);
+  }
+
+  direct_file(const char* pathname, int flags, ::mode_t mode = 0)
+  {
+    std::error_code ec;
+    open(pathname, flags, mode, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "direct_file pathname: [", pathname, "], flags: [", flags, "]");
+    }
+  }
+
+  // reads up to nbytes, less only at end of file or on error
+  std::size_t pread(void* buffer, std::size_t nbytes, ::off_t offset, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(is_aligned(buffer, offset));
+
+    const std::size_t aligned = nbytes / alignment_.offset * alignment_.offset;
+    std::size_t done = ::cp::pread_exact(direct_, buffer, aligned, offset, ec);
+    if (ec || done < aligned || aligned == nbytes) return done;
+
+    done += ::cp::pread_exact(buffered_, static_cast<char*>(buffer) + aligned, nbytes - aligned, offset + ::off_t(aligned), ec);
+    return done;
+  }
+
+  std::size_t pread(void* buffer, std::size_t nbytes, ::off_t offset)
+  {
+    std::error_code ec;
+    const std::size_t result = pread(buffer, nbytes, offset, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "direct_file::pread fd: [", direct_, "], nbytes: [", nbytes, "], offset: [", offset, "], transferred: [", result, "]");
+    }
+    return result;
+  }
+
+  // writes all of nbytes, less only on error
+  std::size_t pwrite(const void* buffer, std::size_t nbytes, ::off_t offset, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(is_aligned(buffer, offset));
+
+    const std::size_t aligned = nbytes / alignment_.offset * alignment_.offset;
+    std::size_t done = ::cp::pwrite_all(direct_, buffer, aligned, offset, ec);
+    if (ec || aligned == nbytes) return done;
+
+    done += ::cp::pwrite_all(buffered_, static_cast<const char*>(buffer) + aligned, nbytes - aligned, offset + ::off_t(aligned), ec);
+    return done;
+  }
+
+  std::size_t pwrite(const void* buffer, std::size_t nbytes, ::off_t offset)
+  {
+    std::error_code ec;
+    const std::size_t result = pwrite(buffer, nbytes, offset, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "direct_file::pwrite fd: [", direct_, "], nbytes: [", nbytes, "], offset: [", offset, "], transferred: [", result, "]");
+    }
+    return result;
+  }
+
+  bool is_aligned(const void* buffer, ::off_t offset) const noexcept
+  {
+    return 0 == std::uintptr_t(buffer) % alignment_.memory && 0 == std::uint64_t(offset) % alignment_.offset;
+  }
+
+  ::cp::direct_io_alignment    alignment()   const noexcept { return alignment_; }
+  ::cp::file_descriptor const& direct_fd()   const noexcept { return direct_;    }
+  ::cp::file_descriptor const& buffered_fd() const noexcept { return buffered_;  }
+
+private:
+  void open(const char* pathname, int flags, ::mode_t mode, std::error_code& ec)
+  {
+    CP_ASSERT(pathname);
+    CP_ASSERT(0 == (flags & O_DIRECT));
+    CP_ASSERT(0 == (flags & O_APPEND));
+
+    direct_ = ::cp::open(pathname, flags | O_DIRECT, mode, ec);
+    if (CP_UNLIKELY(ec)) return;
+
+    alignment_ = ::cp::probe_direct_io_alignment(direct_, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      direct_.reset();
+      return;
+    }
+
+    buffered_ = ::cp::open(pathname, flags & ~(O_CREAT | O_EXCL | O_TRUNC), ec);
+    if (CP_UNLIKELY(ec)) direct_.reset();
+  }
+
+  ::cp::file_descriptor     direct_;
+  ::cp::file_descriptor     buffered_;
+  ::cp::direct_io_alignment alignment_;
+};
+
+} // namespace cp
+
+#endif
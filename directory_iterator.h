@@ -0,0 +1,198 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string_view>
+
+#if defined(__linux__) && defined(SYS_getdents64)
+
+namespace cp {
+
+// entry returned by directory_iterator, name is nul terminated and stays valid until the
+// iterator is incremented
+struct directory_entry
+{
+  std::uint64_t    ino;
+  unsigned char    type;   // DT_* value, DT_UNKNOWN when file system does not fill it
+  std::string_view name;
+
+  const char* c_str()        const noexcept { return name.data(); }
+  bool is_directory()        const noexcept { return DT_DIR  == type; }
+  bool is_regular_file()     const noexcept { return DT_REG  == type; }
+  bool is_symlink()          const noexcept { return DT_LNK  == type; }
+  bool is_type_unknown()     const noexcept { return DT_UNKNOWN == type; }
+};
+
+// buffer that getdents64 batches are read into, one buffer can be reused for many directories
+class directory_buffer
+{
+public:
+  static constexpr std::size_t default_size = 64 * 1024;
+
+  explicit directory_buffer(std::size_t size = default_size)
+    : data_(new char[size])
+    , size_(size)
+  {
+    CP_ASSERT(size >= ::cp::size_of_dirent());
+  }
+
+  char*       data() const noexcept { return data_.get(); }
+  std::size_t size() const noexcept { return size_;       }
+
+private:
+  std::unique_ptr<char[]> data_;
+  std::size_t             size_;
+};
+
+// input iterator over entries of an open directory, "." and ".." are skipped. entries are read
+// with getdents64 in batches as large as the buffer, so d_type and d_ino are available without
+// stat. when constructed from dir_stream its file descriptor is read directly and the stream
+// must not be used with readdir at the same time. copies share the position, as with any
+// input iterator. on error the iterator becomes end iterator
+class directory_iterator
+{
+public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type        = ::cp::directory_entry;
+  using difference_type   = std::ptrdiff_t;
+  using pointer           = ::cp::directory_entry const*;
+  using reference         = ::cp::directory_entry const&;
+
+  // directory to iterate, the handle must outlive the iterator
+  struct source
+  {
+    source(::cp::file_descriptor const& dir_fd) noexcept : fd(dir_fd.get()) { CP_ASSERT(dir_fd); }
+    source(::cp::dir_stream const& dir) noexcept : fd(::dirfd(dir)) { CP_ASSERT(dir); }
+
+    int fd;
+  };
+
+  // end iterator
+  directory_iterator() noexcept = default;
+
+  directory_iterator(source dir, ::cp::directory_buffer& buffer, std::error_code& ec)
+    : state_(std::make_shared<state>(dir.fd, buffer))
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    increment(ec);
+  }
+
+  directory_iterator(source dir, std::size_t buffer_size, std::error_code& ec)
+    : state_(std::make_shared<state>(dir.fd, buffer_size))
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    increment(ec);
+  }
+
+  directory_iterator(source dir, std::error_code& ec)
+    : directory_iterator(dir, ::cp::directory_buffer::default_size, ec)
+  { }
+
+  directory_iterator(source dir, ::cp::directory_buffer& buffer)
+    : state_(std::make_shared<state>(dir.fd, buffer))
+  {
+    increment();
+  }
+
+  explicit directory_iterator(source dir, std::size_t buffer_size = ::cp::directory_buffer::default_size)
+    : state_(std::make_shared<state>(dir.fd, buffer_size))
+  {
+    increment();
+  }
+
+  reference operator * () const noexcept { CP_ASSERT(state_); return state_->entry;  }
+  pointer   operator ->() const noexcept { CP_ASSERT(state_); return &state_->entry; }
+
+  directory_iterator& increment(std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(state_);
+
+    state& s = *state_;
+    for (;;)
+    {
+      if (s.offset == s.filled)
+      {
+        s.offset = 0;
+        s.filled = ::cp::detail::getdents64(s.fd, s.buffer, s.capacity, ec);
+        if (CP_UNLIKELY(0 == s.filled))
+        {
+          state_.reset();
+          return *this;
+        }
+      }
+
+      ::cp::linux_dirent64 const* const record = reinterpret_cast<::cp::linux_dirent64 const*>(s.buffer + s.offset);
+      s.offset += record->d_reclen;
+
+      const char* const name = record->d_name;
+      if ('.' == name[0] && ('\0' == name[1] || ('.' == name[1] && '\0' == name[2]))) continue;
+
+      s.entry = ::cp::directory_entry{ record->d_ino, record->d_type, std::string_view(name, std::strlen(name)) };
+      return *this;
+    }
+  }
+
+  directory_iterator& increment()
+  {
+    const int fd = state_ ? state_->fd : -1;
+    std::error_code ec;
+    increment(ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "directory_iterator dir_fd: [", fd, "]");
+    }
+    return *this;
+  }
+
+  directory_iterator& operator ++ () { return increment(); }
+  void                operator ++ (int) { increment(); }
+
+  friend bool operator == (directory_iterator const& a, directory_iterator const& b) noexcept { return a.state_ == b.state_; }
+  friend bool operator != (directory_iterator const& a, directory_iterator const& b) noexcept { return a.state_ != b.state_; }
+
+private:
+  struct state
+  {
+    state(int fd, ::cp::directory_buffer& buffer) noexcept
+      : fd(fd), buffer(buffer.data()), capacity(buffer.size())
+    { }
+
+    state(int fd, std::size_t buffer_size)
+      : fd(fd), owned(new char[buffer_size]), buffer(owned.get()), capacity(buffer_size)
+    {
+      CP_ASSERT(buffer_size >= ::cp::size_of_dirent());
+    }
+
+    int                     fd;
+    std::unique_ptr<char[]> owned;
+    char*                   buffer;
+    std::size_t             capacity;
+    std::size_t             offset = 0;
+    std::size_t             filled = 0;
+    ::cp::directory_entry   entry{};
+  };
+
+  std::shared_ptr<state> state_;
+};
+
+// range support, for (auto const& entry : cp::directory_iterator(fd))
+inline ::cp::directory_iterator begin(::cp::directory_iterator it) noexcept { return it; }
+inline ::cp::directory_iterator end(::cp::directory_iterator const&) noexcept { return ::cp::directory_iterator(); }
+
+} // namespace cp
+
+#endif
@@ -0,0 +1,266 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+
+#if defined(__linux__) && defined(SEEK_DATA) && defined(SEEK_HOLE)
+
+namespace cp {
+
+// range of a file that is either data or hole
+struct file_extent
+{
+  ::off_t offset;
+  ::off_t length;
+  bool    data;
+  bool    unwritten;  // preallocated and never written, reads as zeros. known only with fiemap
+
+  ::off_t end()     const noexcept { return offset + length; }
+  bool    is_hole() const noexcept { return !data;           }
+};
+
+// input iterator over data and hole ranges of a file, in order, together covering the file from
+// 0 to its size when the iterator was created. with fiemap one ioctl returns many extents and
+// unwritten extents are recognized, adjacent data extents may be reported separately. when file
+// system does not support fiemap, SEEK_DATA and SEEK_HOLE are used. fd must outlive the
+// iterator, copies share the position. on error the iterator becomes end iterator
+class extent_iterator
+{
+public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type        = ::cp::file_extent;
+  using difference_type   = std::ptrdiff_t;
+  using pointer           = ::cp::file_extent const*;
+  using reference         = ::cp::file_extent const&;
+
+  enum class method { automatic, seek, fiemap };
+
+  // end iterator
+  extent_iterator() noexcept = default;
+
+  extent_iterator(::cp::file_descriptor const& fd, method how, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(fd);
+
+    ::cp::file_info info;
+    ::cp::fstat(fd, info, ec);
+    if (CP_UNLIKELY(ec)) return;
+
+    state_ = std::make_shared<state>(fd.get(), info.size(), how);
+    increment(ec);
+  }
+
+  extent_iterator(::cp::file_descriptor const& fd, std::error_code& ec)
+    : extent_iterator(fd, method::automatic, ec)
+  { }
+
+  explicit extent_iterator(::cp::file_descriptor const& fd, method how = method::automatic)
+  {
+    std::error_code ec;
+    *this = extent_iterator(fd, how, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "extent_iterator fd: [", fd, "]");
+    }
+  }
+
+  reference operator * () const noexcept { CP_ASSERT(state_); return state_->extent;  }
+  pointer   operator ->() const noexcept { CP_ASSERT(state_); return &state_->extent; }
+
+  extent_iterator& increment(std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(state_);
+
+    state& s = *state_;
+    if (s.position >= s.size)
+    {
+      state_.reset();
+      return *this;
+    }
+
+    if (method::seek != s.how)
+    {
+      const bool found = next_mapped(s, ec);
+      if (!found && method::automatic == s.how && is_fiemap_unsupported(ec))
+      {
+        ec.clear();
+        s.how = method::seek;
+      }
+    }
+    if (method::seek == s.how) next_sought(s, ec);
+
+    if (CP_UNLIKELY(ec))
+    {
+      state_.reset();
+      return *this;
+    }
+    s.position = s.extent.end();
+    return *this;
+  }
+
+  extent_iterator& increment()
+  {
+    const int fd = state_ ? state_->fd : -1;
+    std::error_code ec;
+    increment(ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "extent_iterator fd: [", fd, "]");
+    }
+    return *this;
+  }
+
+  extent_iterator& operator ++ () { return increment(); }
+  void             operator ++ (int) { increment(); }
+
+  friend bool operator == (extent_iterator const& a, extent_iterator const& b) noexcept { return a.state_ == b.state_; }
+  friend bool operator != (extent_iterator const& a, extent_iterator const& b) noexcept { return a.state_ != b.state_; }
+
+private:
+  // extents returned by one FS_IOC_FIEMAP call
+  static constexpr std::size_t fiemap_batch = 64;
+
+  // fiemap header followed by fiemap_batch extents, in 8 byte words
+  static constexpr std::size_t fiemap_words = (sizeof(::fiemap) + fiemap_batch * sizeof(::fiemap_extent) + 7) / 8;
+
+  struct state
+  {
+    state(int fd, ::off_t size, method how) noexcept : fd(fd), size(size), how(how) { }
+
+    int                              fd;
+    ::off_t                          size;
+    method                           how;
+    ::off_t                          position = 0;
+    ::cp::file_extent                extent{};
+    std::unique_ptr<std::uint64_t[]> storage;
+    ::fiemap*                        map    = nullptr;
+    std::uint32_t                    mapped = 0;   // extents in map
+    std::uint32_t                    next   = 0;   // first extent in map not yet passed
+    bool                             last   = false;
+  };
+
+  static bool is_fiemap_unsupported(std::error_code const& ec) noexcept
+  {
+    return ec == std::errc::operation_not_supported || ec == std::errc::inappropriate_io_control_operation
+        || ec == std::errc::invalid_argument || ec == std::errc::function_not_supported;
+  }
+
+  // SEEK_DATA and SEEK_HOLE, both start at position
+  static void next_sought(state& s, std::error_code& ec) noexcept
+  {
+    const ::off_t data = ::lseek(s.fd, s.position, SEEK_DATA);
+    if (-1 == data)
+    {
+      if (ENXIO != errno)
+      {
+        ec = ::cp::make_system_error_code();
+        return;
+      }
+      // rest of the file is a hole
+      s.extent = ::cp::file_extent{ s.position, s.size - s.position, false, false };
+      return;
+    }
+    if (data > s.position)
+    {
+      s.extent = ::cp::file_extent{ s.position, std::min(data, s.size) - s.position, false, false };
+      return;
+    }
+
+    const ::off_t hole = ::lseek(s.fd, s.position, SEEK_HOLE);
+    if (CP_UNLIKELY(-1 == hole))
+    {
+      ec = ::cp::make_system_error_code();
+      return;
+    }
+    s.extent = ::cp::file_extent{ s.position, std::min(hole, s.size) - s.position, true, false };
+  }
+
+  // extent at position from fiemap, false on error
+  static bool next_mapped(state& s, std::error_code& ec) noexcept
+  {
+    for (;;)
+    {
+      // extents that end before position are passed
+      while (s.next < s.mapped && ::off_t(s.map->fm_extents[s.next].fe_logical + s.map->fm_extents[s.next].fe_length) <= s.position) ++s.next;
+
+      if (s.next < s.mapped)
+      {
+        ::fiemap_extent const& e = s.map->fm_extents[s.next];
+        const ::off_t first = ::off_t(e.fe_logical);
+        if (first > s.position)
+        {
+          s.extent = ::cp::file_extent{ s.position, std::min(first, s.size) - s.position, false, false };
+        }
+        else
+        {
+          const ::off_t end = std::min(::off_t(e.fe_logical + e.fe_length), s.size);
+          s.extent = ::cp::file_extent{ s.position, end - s.position, true, 0 != (e.fe_flags & FIEMAP_EXTENT_UNWRITTEN) };
+        }
+        return true;
+      }
+
+      if (s.last)
+      {
+        s.extent = ::cp::file_extent{ s.position, s.size - s.position, false, false };
+        return true;
+      }
+
+      if (!s.map)
+      {
+        s.storage.reset(new (std::nothrow) std::uint64_t[fiemap_words]);
+        if (!s.storage)
+        {
+          ec = std::make_error_code(std::errc::not_enough_memory);
+          return false;
+        }
+        s.map = reinterpret_cast<::fiemap*>(s.storage.get());
+      }
+
+      std::memset(s.map, 0, sizeof(::fiemap));
+      s.map->fm_start        = std::uint64_t(s.position);
+      s.map->fm_length       = std::uint64_t(s.size - s.position);
+      s.map->fm_extent_count = fiemap_batch;
+      if (-1 == ::ioctl(s.fd, FS_IOC_FIEMAP, s.map))
+      {
+        ec = ::cp::make_system_error_code();
+        return false;
+      }
+
+      s.mapped = s.map->fm_mapped_extents;
+      s.next   = 0;
+      s.last   = 0 == s.mapped || 0 != (s.map->fm_extents[s.mapped - 1].fe_flags & FIEMAP_EXTENT_LAST);
+      // fewer extents than asked for means no more of them in the range
+      if (s.mapped < fiemap_batch) s.last = true;
+    }
+  }
+
+  std::shared_ptr<state> state_;
+};
+
+// range support, for (auto const& extent : cp::extent_iterator(fd))
+inline ::cp::extent_iterator begin(::cp::extent_iterator it) noexcept { return it; }
+inline ::cp::extent_iterator end(::cp::extent_iterator const&) noexcept { return ::cp::extent_iterator(); }
+
+} // namespace cp
+
+#endif
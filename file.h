@@ -6,6 +6,7 @@
 //          https://www.boost.org/LICENSE_1_0.txt)
 
 #include <cstdio>
+#include <cstdint>
 #include "config.h"
 #include "unique_handle.h"
 #include "basic_to_string.h"
@@ -20,9 +21,14 @@ struct file_traits
 
 using file = ::cp::unique_handle<FILE*, ::cp::file_traits>;
 
-std::string to_string( file const& f) 
+inline std::string to_string( file const& f) 
 {
-  return f ? ::cp::to_string(::cp::to_string(std::uintptr_t(f.get()))) : "invalid";
+  return f ? ::cp::to_string(std::uintptr_t(f.get())) : "invalid";
+}
+
+inline std::to_chars_result to_chars(char* first, char* last, file const& f) noexcept
+{
+  return f ? ::cp::to_chars(first, last, std::uintptr_t(f.get())) : ::cp::to_chars(first, last, "invalid");
 }
 
 CP_DEFINE_SERIALIZATION_SPECIALIZATION(::cp::file);
@@ -0,0 +1,357 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if (_POSIX_C_SOURCE >= 1 || _XOPEN_SOURCE || _BSD_SOURCE || _SVID_SOURCE || _POSIX_SOURCE )
+
+namespace cp {
+
+namespace detail {
+  // largest buffer given to get*_r calls, groups with huge member lists fail with ERANGE above it
+  constexpr std::size_t identity_max_buffer = 1024 * 1024;
+
+  // buffer reused by all lookups of the thread, it only grows. passwd and group lookups share it
+  // and have different minimal sizes, so the hint is checked on every call
+  CP_FORCE_INLINE
+  std::vector<char>& identity_buffer(long size_hint)
+  {
+    thread_local std::vector<char> buffer;
+    const std::size_t size = size_hint > 0 ? std::size_t(size_hint) : std::size_t(1024);
+    if (buffer.size() < size) buffer.resize(size);
+    return buffer;
+  }
+
+  // some NSS modules report missing entry as an error instead of null result
+  CP_FORCE_INLINE
+  bool is_identity_not_found(std::error_code const& ec) noexcept
+  {
+    return ec == std::errc::no_such_file_or_directory || ec == std::errc::no_such_process;
+  }
+
+  // calls lookup(buffer, size, ec) and doubles the buffer while it fails with ERANGE
+  template <typename Lookup>
+  bool lookup_identity(long size_hint, Lookup const& lookup, std::error_code& ec)
+  {
+    std::vector<char>& buffer = ::cp::detail::identity_buffer(size_hint);
+    for (;;)
+    {
+      const bool found = lookup(buffer.data(), buffer.size(), ec);
+      if (CP_LIKELY(!ec)) return found;
+      if (::cp::detail::is_identity_not_found(ec))
+      {
+        ec.clear();
+        return false;
+      }
+      if (ec != std::errc::result_out_of_range || buffer.size() >= identity_max_buffer) return false;
+      ec.clear();
+      buffer.resize(buffer.size() * 2);
+    }
+  }
+
+  // map split into shards with their own lock, readers of different shards never meet
+  template <typename Key, typename Value>
+  class identity_map
+  {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    explicit identity_map(unsigned shards)
+      : shards_(new shard[shards])
+      , count_(shards)
+    { }
+
+    // returns true when key is cached and not expired, found tells if identity exists
+    bool lookup(Key const& key, Value& value, bool& found) const
+    {
+      shard const& s = shard_of(key);
+      std::shared_lock<std::shared_mutex> lock(s.mutex);
+      const auto it = s.entries.find(key);
+      if (it == s.entries.end() || it->second.expires <= clock::now()) return false;
+      found = it->second.found;
+      if (found) value = it->second.value;
+      return true;
+    }
+
+    void store(Key const& key, Value const& value, bool found, clock::duration ttl)
+    {
+      shard& s = shard_of(key);
+      std::lock_guard<std::shared_mutex> lock(s.mutex);
+      entry& e  = s.entries[key];
+      e.value   = value;
+      e.found   = found;
+      e.expires = clock::now() + ttl;
+    }
+
+    void clear()
+    {
+      for (std::size_t i = 0; i < count_; ++i)
+      {
+        std::lock_guard<std::shared_mutex> lock(shards_[i].mutex);
+        shards_[i].entries.clear();
+      }
+    }
+
+  private:
+    struct entry
+    {
+      Value             value{};
+      bool              found = false;
+      clock::time_point expires;
+    };
+
+    struct shard
+    {
+      mutable std::shared_mutex          mutex;
+      std::unordered_map<Key, entry>     entries;
+    };
+
+    shard&       shard_of(Key const& key)       noexcept { return shards_[std::hash<Key>()(key) % count_]; }
+    shard const& shard_of(Key const& key) const noexcept { return shards_[std::hash<Key>()(key) % count_]; }
+
+    std::unique_ptr<shard[]> shards_;
+    std::size_t              count_;
+  };
+}
+
+// thread safe cache of user and group names in front of getpw*_r and getgr*_r. missing users and
+// groups are cached too, for negative_ttl. errors other than ERANGE, which grows the lookup buffer,
+// are reported and not cached
+class identity_cache
+{
+  identity_cache(identity_cache const&) = delete;
+  identity_cache& operator = (identity_cache const&) = delete;
+
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct options
+  {
+    clock::duration ttl          = std::chrono::minutes(5);
+    clock::duration negative_ttl = std::chrono::seconds(30);
+    unsigned        shards       = 16;
+  };
+
+  identity_cache() : identity_cache(options()) { }
+
+  explicit identity_cache(options const& opts)
+    : options_(opts)
+    , user_names_(opts.shards)
+    , user_ids_(opts.shards)
+    , group_names_(opts.shards)
+    , group_ids_(opts.shards)
+  {
+    CP_ASSERT(opts.shards > 0);
+  }
+
+  // returns false when there is no such user
+  bool user_name(::uid_t uid, std::string& name, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    bool found;
+    if (user_names_.lookup(uid, name, found)) return found;
+
+    ::passwd pwd;
+    found = ::cp::detail::lookup_identity(::cp::detail::getpw_r_size_max(), [&](char* buf, std::size_t size, std::error_code& e) {
+      return ::cp::getpwuid_r(uid, &pwd, buf, size, e);
+    }, ec);
+    if (CP_UNLIKELY(ec)) return false;
+
+    if (found) name = pwd.pw_name; else name.clear();
+    user_names_.store(uid, name, found, found ? options_.ttl : options_.negative_ttl);
+    return found;
+  }
+
+  bool user_name(::uid_t uid, std::string& name)
+  {
+    std::error_code ec;
+    const bool found = user_name(uid, name, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "identity_cache::user_name uid: [", uid, "]");
+    }
+    return found;
+  }
+
+  bool user_id(const char* name, ::uid_t& uid, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(name);
+
+    const std::string key(name);
+    bool found;
+    if (user_ids_.lookup(key, uid, found)) return found;
+
+    ::passwd pwd;
+    found = ::cp::detail::lookup_identity(::cp::detail::getpw_r_size_max(), [&](char* buf, std::size_t size, std::error_code& e) {
+      return ::cp::getpwnam_r(name, &pwd, buf, size, e);
+    }, ec);
+    if (CP_UNLIKELY(ec)) return false;
+
+    if (found) uid = pwd.pw_uid;
+    user_ids_.store(key, uid, found, found ? options_.ttl : options_.negative_ttl);
+    return found;
+  }
+
+  bool user_id(const char* name, ::uid_t& uid)
+  {
+    std::error_code ec;
+    const bool found = user_id(name, uid, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "identity_cache::user_id name: [", name, "]");
+    }
+    return found;
+  }
+
+  bool group_name(::gid_t gid, std::string& name, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    bool found;
+    if (group_names_.lookup(gid, name, found)) return found;
+
+    ::group grp;
+    found = ::cp::detail::lookup_identity(::cp::detail::getgr_r_size_max(), [&](char* buf, std::size_t size, std::error_code& e) {
+      return ::cp::getgrgid_r(gid, &grp, buf, size, e);
+    }, ec);
+    if (CP_UNLIKELY(ec)) return false;
+
+    if (found) name = grp.gr_name; else name.clear();
+    group_names_.store(gid, name, found, found ? options_.ttl : options_.negative_ttl);
+    return found;
+  }
+
+  bool group_name(::gid_t gid, std::string& name)
+  {
+    std::error_code ec;
+    const bool found = group_name(gid, name, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "identity_cache::group_name gid: [", gid, "]");
+    }
+    return found;
+  }
+
+  bool group_id(const char* name, ::gid_t& gid, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(name);
+
+    const std::string key(name);
+    bool found;
+    if (group_ids_.lookup(key, gid, found)) return found;
+
+    ::group grp;
+    found = ::cp::detail::lookup_identity(::cp::detail::getgr_r_size_max(), [&](char* buf, std::size_t size, std::error_code& e) {
+      return ::cp::getgrnam_r(name, &grp, buf, size, e);
+    }, ec);
+    if (CP_UNLIKELY(ec)) return false;
+
+    if (found) gid = grp.gr_gid;
+    group_ids_.store(key, gid, found, found ? options_.ttl : options_.negative_ttl);
+    return found;
+  }
+
+  bool group_id(const char* name, ::gid_t& gid)
+  {
+    std::error_code ec;
+    const bool found = group_id(name, gid, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "identity_cache::group_id name: [", name, "]");
+    }
+    return found;
+  }
+
+  // batch forms, names[i] is left empty when uids[i] does not exist or errors[i] is set. every
+  // distinct id that is not cached is looked up only once
+  std::size_t user_names(::uid_t const* uids, std::size_t count, std::string* names, std::error_code* errors)
+  {
+    return resolve_batch(uids, count, names, errors, [this](::uid_t uid, std::string& name, std::error_code& ec) {
+      return user_name(uid, name, ec);
+    });
+  }
+
+  std::size_t group_names(::gid_t const* gids, std::size_t count, std::string* names, std::error_code* errors)
+  {
+    return resolve_batch(gids, count, names, errors, [this](::gid_t gid, std::string& name, std::error_code& ec) {
+      return group_name(gid, name, ec);
+    });
+  }
+
+  // drops everything, for example after /etc/passwd or /etc/group is changed
+  void clear()
+  {
+    user_names_.clear();
+    user_ids_.clear();
+    group_names_.clear();
+    group_ids_.clear();
+  }
+
+private:
+  // returns number of entries that failed with an error
+  template <typename Id, typename Resolve>
+  std::size_t resolve_batch(Id const* ids, std::size_t count, std::string* names, std::error_code* errors, Resolve const& resolve)
+  {
+    CP_ASSERT(ids || 0 == count);
+    CP_ASSERT(names || 0 == count);
+    CP_ASSERT(errors || 0 == count);
+
+    // ids sorted with their positions so that duplicates are resolved together
+    std::vector<std::pair<Id, std::size_t>> order;
+    order.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) order.emplace_back(ids[i], i);
+    std::sort(order.begin(), order.end());
+
+    std::size_t failed = 0;
+    for (std::size_t first = 0; first < order.size(); )
+    {
+      std::size_t last = first + 1;
+      while (last < order.size() && order[last].first == order[first].first) ++last;
+
+      const std::size_t i = order[first].second;
+      errors[i].clear();
+      if (!resolve(order[first].first, names[i], errors[i])) names[i].clear();
+      if (errors[i]) failed += last - first;
+
+      for (std::size_t k = first + 1; k < last; ++k)
+      {
+        names[order[k].second]  = names[i];
+        errors[order[k].second] = errors[i];
+      }
+      first = last;
+    }
+    return failed;
+  }
+
+  options const                                   options_;
+  ::cp::detail::identity_map<::uid_t, std::string> user_names_;
+  ::cp::detail::identity_map<std::string, ::uid_t> user_ids_;
+  ::cp::detail::identity_map<::gid_t, std::string> group_names_;
+  ::cp::detail::identity_map<std::string, ::gid_t> group_ids_;
+};
+
+} // namespace cp
+
+#endif
@@ -0,0 +1,498 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cp {
+
+namespace detail {
+  // getpwent and getgrent share static state inside of libc, snapshots are taken one at a time
+  CP_FORCE_INLINE
+  std::mutex& identity_enumeration_mutex() noexcept
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  // identity of the source file, snapshot is reloaded only when it changes. files that can not
+  // be stated (users provided only by NSS modules) are treated as never changing
+  struct identity_source
+  {
+    explicit identity_source(const char* path) noexcept
+    {
+      std::error_code ec;
+      ::cp::file_info info;
+      ::cp::stat(path, info, ec);
+      if (ec) return;
+
+      valid = true;
+      ino   = info.inode_number();
+      size  = info.size();
+      mtime = info.last_modification_time();
+    }
+
+    bool operator == (identity_source const& other) const noexcept
+    {
+      if (!valid || !other.valid) return valid == other.valid;
+      return ino == other.ino && size == other.size && mtime.tv_sec == other.mtime.tv_sec && mtime.tv_nsec == other.mtime.tv_nsec;
+    }
+
+    bool       valid = false;
+    ::ino_t    ino   = 0;
+    ::off_t    size  = 0;
+    ::timespec mtime = {};
+  };
+
+  // all strings of a snapshot are kept in one buffer, each one nul terminated so that views
+  // handed out can also be used as c strings
+  class string_pool
+  {
+  public:
+    struct ref
+    {
+      std::uint32_t offset;
+      std::uint32_t size;
+    };
+
+    ref add(const char* s)
+    {
+      const std::size_t size = s ? std::strlen(s) : 0;
+      const ref result{ std::uint32_t(data_.size()), std::uint32_t(size) };
+      data_.append(s ? s : "", size);
+      data_.push_back('\0');
+      return result;
+    }
+
+    // views given by snapshots are nul terminated, so they can be added back as c strings
+    ref add(std::string_view s) { return add(s.data()); }
+
+    std::string_view view(ref r) const noexcept { return std::string_view(data_.data() + r.offset, r.size); }
+    void shrink_to_fit() { data_.shrink_to_fit(); }
+
+  private:
+    std::string data_;
+  };
+
+  // incremental refresh keeps strings of unchanged entries in the snapshot they came from, which
+  // the new one keeps alive. at most this many snapshots are chained that way, and when more than
+  // a quarter of entries changed everything is copied into a new pool and older ones are released
+  constexpr unsigned identity_snapshot_max_depth = 4;
+
+  CP_FORCE_INLINE
+  bool identity_field_equal(std::string_view field, const char* s) noexcept
+  {
+    return field == std::string_view(s ? s : "");
+  }
+}
+
+struct passwd_record
+{
+  ::uid_t          uid;
+  ::gid_t          gid;
+  std::string_view name;
+  std::string_view password;
+  std::string_view gecos;
+  std::string_view home_directory;
+  std::string_view shell;
+};
+
+struct group_record
+{
+  ::gid_t                 gid;
+  std::string_view        name;
+  std::string_view        password;
+  std::string_view const* members_begin;
+  std::string_view const* members_end;
+
+  std::string_view const* begin() const noexcept { return members_begin; }
+  std::string_view const* end()   const noexcept { return members_end;   }
+  std::size_t number_of_members() const noexcept { return std::size_t(members_end - members_begin); }
+};
+
+// immutable copy of the user database taken with one getpwent enumeration. records are kept sorted
+// by uid next to an index sorted by name, so both lookups are binary searches. the snapshot is
+// handed out as shared_ptr to const and can be read from any number of threads. source file is
+// only watched for changes by refresh, entries always come from NSS, so a refresh still enumerates
+// the whole database but copies only entries that differ from the current snapshot
+class passwd_snapshot
+{
+  passwd_snapshot(passwd_snapshot const&) = delete;
+  passwd_snapshot& operator = (passwd_snapshot const&) = delete;
+
+  struct private_tag { };
+
+public:
+  static constexpr const char* default_source = "/etc/passwd";
+
+  static std::shared_ptr<const passwd_snapshot> load(const char* source, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(source);
+
+    std::shared_ptr<passwd_snapshot> result = std::make_shared<passwd_snapshot>(private_tag(), source);
+    result->enumerate(nullptr, ec);
+    if (CP_UNLIKELY(ec)) return nullptr;
+    return result;
+  }
+
+  static std::shared_ptr<const passwd_snapshot> load(std::error_code& ec)
+  {
+    return load(default_source, ec);
+  }
+
+  static std::shared_ptr<const passwd_snapshot> load(const char* source = default_source)
+  {
+    std::error_code ec;
+    std::shared_ptr<const passwd_snapshot> result = load(source, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "passwd_snapshot::load source: [", source, "]");
+    }
+    return result;
+  }
+
+  // returns current when its source file did not change, otherwise takes a new snapshot. records
+  // equal to ones in current keep their strings, only changed and new records are copied
+  static std::shared_ptr<const passwd_snapshot> refresh(std::shared_ptr<const passwd_snapshot> const& current, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(current);
+
+    if (::cp::detail::identity_source(current->source_path_.c_str()) == current->source_) return current;
+
+    std::shared_ptr<passwd_snapshot> result = std::make_shared<passwd_snapshot>(private_tag(), current->source_path_.c_str());
+    result->enumerate(current, ec);
+    if (CP_UNLIKELY(ec)) return nullptr;
+    return result;
+  }
+
+  static std::shared_ptr<const passwd_snapshot> refresh(std::shared_ptr<const passwd_snapshot> const& current)
+  {
+    std::error_code ec;
+    std::shared_ptr<const passwd_snapshot> result = refresh(current, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "passwd_snapshot::refresh source: [", current->source_path_, "]");
+    }
+    return result;
+  }
+
+  passwd_snapshot(private_tag, const char* source)
+    : source_path_(source)
+    , source_(source)
+  { }
+
+  // first record with the uid in enumeration order, nullptr when there is none
+  ::cp::passwd_record const* find(::uid_t uid) const noexcept
+  {
+    const auto it = std::lower_bound(records_.begin(), records_.end(), uid,
+      [](::cp::passwd_record const& r, ::uid_t id) { return r.uid < id; });
+    return (it != records_.end() && it->uid == uid) ? &*it : nullptr;
+  }
+
+  ::cp::passwd_record const* find(std::string_view name) const noexcept
+  {
+    const auto it = std::lower_bound(by_name_.begin(), by_name_.end(), name,
+      [this](std::uint32_t i, std::string_view n) { return records_[i].name < n; });
+    return (it != by_name_.end() && records_[*it].name == name) ? &records_[*it] : nullptr;
+  }
+
+  std::size_t size() const noexcept { return records_.size(); }
+  ::cp::passwd_record const* begin() const noexcept { return records_.data(); }
+  ::cp::passwd_record const* end()   const noexcept { return records_.data() + records_.size(); }
+
+private:
+  // record of this snapshot equal to p, nullptr when there is none
+  ::cp::passwd_record const* find_same(::passwd const& p) const noexcept
+  {
+    ::cp::passwd_record const* const r = find(std::string_view(p.pw_name ? p.pw_name : ""));
+    if (!r || r->uid != p.pw_uid || r->gid != p.pw_gid) return nullptr;
+    using ::cp::detail::identity_field_equal;
+    return (identity_field_equal(r->password, p.pw_passwd) && identity_field_equal(r->gecos, p.pw_gecos) &&
+            identity_field_equal(r->home_directory, p.pw_dir) && identity_field_equal(r->shell, p.pw_shell)) ? r : nullptr;
+  }
+
+  // records equal to ones in previous are taken from it without copying their strings
+  void enumerate(std::shared_ptr<const passwd_snapshot> const& previous, std::error_code& ec)
+  {
+    using ref = ::cp::detail::string_pool::ref;
+    struct entry
+    {
+      ::cp::passwd_record const* same;
+      ::uid_t                    uid;
+      ::gid_t                    gid;
+      ref                        fields[5];
+    };
+
+    std::vector<entry> entries;
+    std::size_t        changed = 0;
+    {
+      std::lock_guard<std::mutex> lock(::cp::detail::identity_enumeration_mutex());
+      ::cp::pswd_environment environment;
+      while (::passwd* const p = environment.getpwent(ec))
+      {
+        ::cp::passwd_record const* const same = previous ? previous->find_same(*p) : nullptr;
+        if (same)
+        {
+          entries.push_back(entry{ same, p->pw_uid, p->pw_gid, {} });
+          continue;
+        }
+        ++changed;
+        entries.push_back(entry{ nullptr, p->pw_uid, p->pw_gid,
+          { pool_.add(p->pw_name), pool_.add(p->pw_passwd), pool_.add(p->pw_gecos), pool_.add(p->pw_dir), pool_.add(p->pw_shell) } });
+      }
+      // nss_files reports the end of the database with ENOENT
+      if (ec == std::errc::no_such_file_or_directory) ec.clear();
+      if (CP_UNLIKELY(ec)) return;
+    }
+
+    if (previous && previous->depth_ + 1 < ::cp::detail::identity_snapshot_max_depth && changed * 4 <= entries.size())
+    {
+      base_  = previous;
+      depth_ = previous->depth_ + 1;
+    }
+    else
+    {
+      for (entry& e : entries)
+      {
+        if (!e.same) continue;
+        e.fields[0] = pool_.add(e.same->name);
+        e.fields[1] = pool_.add(e.same->password);
+        e.fields[2] = pool_.add(e.same->gecos);
+        e.fields[3] = pool_.add(e.same->home_directory);
+        e.fields[4] = pool_.add(e.same->shell);
+        e.same = nullptr;
+      }
+    }
+    pool_.shrink_to_fit();
+
+    records_.reserve(entries.size());
+    for (entry const& e : entries)
+    {
+      if (e.same) records_.push_back(*e.same);
+      else records_.push_back(::cp::passwd_record{ e.uid, e.gid,
+        pool_.view(e.fields[0]), pool_.view(e.fields[1]), pool_.view(e.fields[2]), pool_.view(e.fields[3]), pool_.view(e.fields[4]) });
+    }
+    std::stable_sort(records_.begin(), records_.end(),
+      [](::cp::passwd_record const& a, ::cp::passwd_record const& b) { return a.uid < b.uid; });
+
+    by_name_.resize(records_.size());
+    for (std::uint32_t i = 0; i < by_name_.size(); ++i) by_name_[i] = i;
+    std::stable_sort(by_name_.begin(), by_name_.end(),
+      [this](std::uint32_t a, std::uint32_t b) { return records_[a].name < records_[b].name; });
+  }
+
+  const std::string                       source_path_;
+  const ::cp::detail::identity_source     source_;
+  ::cp::detail::string_pool               pool_;
+  std::vector<::cp::passwd_record>        records_;
+  std::vector<std::uint32_t>              by_name_;
+  std::shared_ptr<const passwd_snapshot>  base_;            // owner of strings of unchanged records
+  unsigned                                depth_ = 0;       // incremental refreshes since the last full copy
+};
+
+// same as passwd_snapshot for the group database, member names of all groups are kept in one array.
+// refresh reuses unchanged groups together with their member lists
+class group_snapshot
+{
+  group_snapshot(group_snapshot const&) = delete;
+  group_snapshot& operator = (group_snapshot const&) = delete;
+
+  struct private_tag { };
+
+public:
+  static constexpr const char* default_source = "/etc/group";
+
+  static std::shared_ptr<const group_snapshot> load(const char* source, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(source);
+
+    std::shared_ptr<group_snapshot> result = std::make_shared<group_snapshot>(private_tag(), source);
+    result->enumerate(nullptr, ec);
+    if (CP_UNLIKELY(ec)) return nullptr;
+    return result;
+  }
+
+  static std::shared_ptr<const group_snapshot> load(std::error_code& ec)
+  {
+    return load(default_source, ec);
+  }
+
+  static std::shared_ptr<const group_snapshot> load(const char* source = default_source)
+  {
+    std::error_code ec;
+    std::shared_ptr<const group_snapshot> result = load(source, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "group_snapshot::load source: [", source, "]");
+    }
+    return result;
+  }
+
+  static std::shared_ptr<const group_snapshot> refresh(std::shared_ptr<const group_snapshot> const& current, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(current);
+
+    if (::cp::detail::identity_source(current->source_path_.c_str()) == current->source_) return current;
+
+    std::shared_ptr<group_snapshot> result = std::make_shared<group_snapshot>(private_tag(), current->source_path_.c_str());
+    result->enumerate(current, ec);
+    if (CP_UNLIKELY(ec)) return nullptr;
+    return result;
+  }
+
+  static std::shared_ptr<const group_snapshot> refresh(std::shared_ptr<const group_snapshot> const& current)
+  {
+    std::error_code ec;
+    std::shared_ptr<const group_snapshot> result = refresh(current, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "group_snapshot::refresh source: [", current->source_path_, "]");
+    }
+    return result;
+  }
+
+  group_snapshot(private_tag, const char* source)
+    : source_path_(source)
+    , source_(source)
+  { }
+
+  ::cp::group_record const* find(::gid_t gid) const noexcept
+  {
+    const auto it = std::lower_bound(records_.begin(), records_.end(), gid,
+      [](::cp::group_record const& r, ::gid_t id) { return r.gid < id; });
+    return (it != records_.end() && it->gid == gid) ? &*it : nullptr;
+  }
+
+  ::cp::group_record const* find(std::string_view name) const noexcept
+  {
+    const auto it = std::lower_bound(by_name_.begin(), by_name_.end(), name,
+      [this](std::uint32_t i, std::string_view n) { return records_[i].name < n; });
+    return (it != by_name_.end() && records_[*it].name == name) ? &records_[*it] : nullptr;
+  }
+
+  std::size_t size() const noexcept { return records_.size(); }
+  ::cp::group_record const* begin() const noexcept { return records_.data(); }
+  ::cp::group_record const* end()   const noexcept { return records_.data() + records_.size(); }
+
+private:
+  // record of this snapshot equal to g, nullptr when there is none
+  ::cp::group_record const* find_same(::group const& g) const noexcept
+  {
+    ::cp::group_record const* const r = find(std::string_view(g.gr_name ? g.gr_name : ""));
+    if (!r || r->gid != g.gr_gid || !::cp::detail::identity_field_equal(r->password, g.gr_passwd)) return nullptr;
+
+    std::string_view const* member = r->begin();
+    for (char** m = g.gr_mem; m && *m; ++m, ++member)
+    {
+      if (member == r->end() || *member != *m) return nullptr;
+    }
+    return member == r->end() ? r : nullptr;
+  }
+
+  // records equal to ones in previous are taken from it together with their member lists
+  void enumerate(std::shared_ptr<const group_snapshot> const& previous, std::error_code& ec)
+  {
+    using ref = ::cp::detail::string_pool::ref;
+    struct entry
+    {
+      ::cp::group_record const* same;
+      ::gid_t                   gid;
+      ref                       name;
+      ref                       password;
+      std::size_t               members_first;
+      std::size_t               members_last;
+    };
+
+    std::vector<entry> entries;
+    std::vector<ref>   members;
+    std::size_t        changed = 0;
+    {
+      std::lock_guard<std::mutex> lock(::cp::detail::identity_enumeration_mutex());
+      ::cp::grp_environment environment;
+      while (::group* const g = environment.getgrent(ec))
+      {
+        ::cp::group_record const* const same = previous ? previous->find_same(*g) : nullptr;
+        if (same)
+        {
+          entries.push_back(entry{ same, g->gr_gid, {}, {}, 0, 0 });
+          continue;
+        }
+        ++changed;
+        const std::size_t first = members.size();
+        for (char** m = g->gr_mem; m && *m; ++m) members.push_back(pool_.add(*m));
+        entries.push_back(entry{ nullptr, g->gr_gid, pool_.add(g->gr_name), pool_.add(g->gr_passwd), first, members.size() });
+      }
+      if (ec == std::errc::no_such_file_or_directory) ec.clear();
+      if (CP_UNLIKELY(ec)) return;
+    }
+
+    if (previous && previous->depth_ + 1 < ::cp::detail::identity_snapshot_max_depth && changed * 4 <= entries.size())
+    {
+      base_  = previous;
+      depth_ = previous->depth_ + 1;
+    }
+    else
+    {
+      for (entry& e : entries)
+      {
+        if (!e.same) continue;
+        e.members_first = members.size();
+        for (std::string_view m : *e.same) members.push_back(pool_.add(m));
+        e.members_last = members.size();
+        e.name         = pool_.add(e.same->name);
+        e.password     = pool_.add(e.same->password);
+        e.same         = nullptr;
+      }
+    }
+    pool_.shrink_to_fit();
+
+    members_.reserve(members.size());
+    for (ref m : members) members_.push_back(pool_.view(m));
+
+    records_.reserve(entries.size());
+    for (entry const& e : entries)
+    {
+      if (e.same) records_.push_back(*e.same);
+      else records_.push_back(::cp::group_record{ e.gid, pool_.view(e.name), pool_.view(e.password),
+        members_.data() + e.members_first, members_.data() + e.members_last });
+    }
+    std::stable_sort(records_.begin(), records_.end(),
+      [](::cp::group_record const& a, ::cp::group_record const& b) { return a.gid < b.gid; });
+
+    by_name_.resize(records_.size());
+    for (std::uint32_t i = 0; i < by_name_.size(); ++i) by_name_[i] = i;
+    std::stable_sort(by_name_.begin(), by_name_.end(),
+      [this](std::uint32_t a, std::uint32_t b) { return records_[a].name < records_[b].name; });
+  }
+
+  const std::string                       source_path_;
+  const ::cp::detail::identity_source     source_;
+  ::cp::detail::string_pool               pool_;
+  std::vector<std::string_view>           members_;
+  std::vector<::cp::group_record>         records_;
+  std::vector<std::uint32_t>              by_name_;
+  std::shared_ptr<const group_snapshot>   base_;            // owner of strings and members of unchanged records
+  unsigned                                depth_ = 0;       // incremental refreshes since the last full copy
+};
+
+} // namespace cp
@@ -0,0 +1,748 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+#include "mapped_region.h"
+#include "thread_pool.h"
+
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#  include <linux/io_uring.h>
+#  if defined(IO_URING_OP_SUPPORTED) && defined(__NR_io_uring_setup)
+#    define CP_HAS_IO_URING 1
+#  endif
+#endif
+
+#ifndef CP_HAS_IO_URING
+#define CP_HAS_IO_URING 0
+#endif
+
+namespace cp {
+
+struct io_completion
+{
+  std::uint64_t   user_data;
+  std::int64_t    result;     // bytes transferred, new file descriptor for openat, 0 for fsync and statx, -1 on error
+  std::error_code ec;
+};
+
+namespace detail {
+  enum class io_opcode : std::uint8_t
+  {
+    read,
+    write,
+    read_fixed,
+    write_fixed,
+    fsync,
+    fdatasync,
+    openat,
+    statx
+  };
+
+  struct io_request
+  {
+    io_opcode     op;
+    bool          fixed_file;
+    int           fd;
+    void*         buffer;
+    std::size_t   length;
+    ::off_t       offset;
+    unsigned      buffer_index;
+    int           flags;
+    unsigned      mode;       // mode for openat, mask for statx
+    const char*   path;
+    std::uint64_t user_data;
+  };
+
+  CP_FORCE_INLINE
+  ::cp::io_completion make_io_completion(std::uint64_t user_data, std::int64_t result) noexcept
+  {
+    if (CP_UNLIKELY(result < 0)) {
+      return ::cp::io_completion{ user_data, -1, ::cp::make_system_error_code(int(-result)) };
+    }
+    return ::cp::io_completion{ user_data, result, std::error_code() };
+  }
+}
+
+// batched asynchronous file I/O. requests are queued with read/write/fsync/... calls, handed to the
+// kernel with submit() and their results are collected with peek()/wait(). when io_uring is not
+// available (old kernel, seccomp filter, missing opcodes) requests are executed on a thread pool with
+// the same interface and results.
+//
+// io_ring object is meant to be used from one thread. buffers, paths and statx structures passed
+// to requests must stay valid until the completion of the request is reaped and the ring must not
+// be destroyed while requests are in flight.
+class io_ring
+{
+  io_ring(io_ring const&) = delete;
+  io_ring& operator = (io_ring const&) = delete;
+
+public:
+  enum class backend
+  {
+    io_uring,
+    thread_pool
+  };
+
+  // index into the table set with register_files
+  struct fixed_file
+  {
+    unsigned index;
+  };
+
+  // target of the request, either plain file descriptor or registered file
+  struct io_file
+  {
+    io_file(::cp::file_descriptor const& fd) noexcept : fd(fd.get()), fixed(false) { CP_ASSERT(fd); }
+    io_file(fixed_file file) noexcept : fd(int(file.index)), fixed(true) { }
+
+    int  fd;
+    bool fixed;
+  };
+
+  io_ring(unsigned entries, backend preferred, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    open(entries, preferred, ec);
+  }
+
+  io_ring(unsigned entries, std::error_code& ec)
+    : io_ring(entries, backend::io_uring, ec)
+  { }
+
+  io_ring(unsigned entries, backend preferred)
+  {
+    std::error_code ec;
+    open(entries, preferred, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "io_ring entries: [", entries, "]");
+    }
+  }
+
+  explicit io_ring(unsigned entries)
+    : io_ring(entries, backend::io_uring)
+  { }
+
+  ~io_ring()
+  {
+    CP_ASSERT_MSG(0 == in_flight_, "io_ring destroyed with requests in flight");
+  }
+
+  backend     get_backend() const noexcept { return backend_;        }
+  std::size_t pending()     const noexcept { return pending_.size(); }
+  std::size_t in_flight()   const noexcept { return in_flight_;      }
+
+  // offset -1 uses and advances the file position
+  void read(io_file file, void* buffer, std::size_t nbytes, ::off_t offset, std::uint64_t user_data)
+  {
+    CP_ASSERT(buffer);
+    CP_ASSERT(nbytes <= std::numeric_limits<std::uint32_t>::max());
+    queue({ ::cp::detail::io_opcode::read, file.fixed, file.fd, buffer, nbytes, offset, 0, 0, 0, nullptr, user_data });
+  }
+
+  void write(io_file file, const void* buffer, std::size_t nbytes, ::off_t offset, std::uint64_t user_data)
+  {
+    CP_ASSERT(buffer);
+    CP_ASSERT(nbytes <= std::numeric_limits<std::uint32_t>::max());
+    queue({ ::cp::detail::io_opcode::write, file.fixed, file.fd, const_cast<void*>(buffer), nbytes, offset, 0, 0, 0, nullptr, user_data });
+  }
+
+  // buffer must be inside of the buffer registered at buffer_index
+  void read_fixed(io_file file, void* buffer, std::size_t nbytes, ::off_t offset, unsigned buffer_index, std::uint64_t user_data)
+  {
+    CP_ASSERT(buffer);
+    CP_ASSERT(buffer_index < registered_buffers_);
+    CP_ASSERT(nbytes <= std::numeric_limits<std::uint32_t>::max());
+    queue({ ::cp::detail::io_opcode::read_fixed, file.fixed, file.fd, buffer, nbytes, offset, buffer_index, 0, 0, nullptr, user_data });
+  }
+
+  void write_fixed(io_file file, const void* buffer, std::size_t nbytes, ::off_t offset, unsigned buffer_index, std::uint64_t user_data)
+  {
+    CP_ASSERT(buffer);
+    CP_ASSERT(buffer_index < registered_buffers_);
+    CP_ASSERT(nbytes <= std::numeric_limits<std::uint32_t>::max());
+    queue({ ::cp::detail::io_opcode::write_fixed, file.fixed, file.fd, const_cast<void*>(buffer), nbytes, offset, buffer_index, 0, 0, nullptr, user_data });
+  }
+
+  void fsync(io_file file, std::uint64_t user_data)
+  {
+    queue({ ::cp::detail::io_opcode::fsync, file.fixed, file.fd, nullptr, 0, 0, 0, 0, 0, nullptr, user_data });
+  }
+
+  void fdatasync(io_file file, std::uint64_t user_data)
+  {
+    queue({ ::cp::detail::io_opcode::fdatasync, file.fixed, file.fd, nullptr, 0, 0, 0, 0, 0, nullptr, user_data });
+  }
+
+  // invalid dirfd means current working directory, result of the completion is the new file
+  // descriptor and it is owned by the caller
+  void openat(::cp::file_descriptor const& dirfd, const char* relpath, int flags, ::mode_t mode, std::uint64_t user_data)
+  {
+    CP_ASSERT(relpath);
+    queue({ ::cp::detail::io_opcode::openat, false, dirfd ? dirfd.get() : AT_FDCWD, nullptr, 0, 0, 0, flags, unsigned(mode), relpath, user_data });
+  }
+
+#if defined STATX_TYPE
+  void statx(::cp::file_descriptor const& dirfd, const char* relpath, int flags, unsigned mask, struct ::statx* buffer, std::uint64_t user_data)
+  {
+    CP_ASSERT(relpath);
+    CP_ASSERT(buffer);
+    queue({ ::cp::detail::io_opcode::statx, false, dirfd ? dirfd.get() : AT_FDCWD, buffer, 0, 0, 0, flags, mask, relpath, user_data });
+  }
+#endif
+
+  // hands all queued requests to the kernel (or to the thread pool) and returns their number
+  std::size_t submit(std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    return submit_and_wait(0, ec);
+  }
+
+  std::size_t submit()
+  {
+    return submit_and_wait(0);
+  }
+
+  // same as submit, but also waits until at least wait_nr completions are ready to be reaped.
+  // completions are not reaped here, so wait_nr must not exceed the completion ring size
+  std::size_t submit_and_wait(unsigned wait_nr, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT_MSG(wait_nr <= in_flight_ + pending_.size(), "waiting for more completions than requests");
+
+#if CP_HAS_IO_URING
+    if (backend::io_uring == backend_) return submit_io_uring(wait_nr, ec);
+#endif
+    return submit_thread_pool(wait_nr);
+  }
+
+  std::size_t submit_and_wait(unsigned wait_nr)
+  {
+    std::error_code ec;
+    const std::size_t result = submit_and_wait(wait_nr, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "io_ring::submit_and_wait wait_nr: [", wait_nr, "], pending: [", pending_.size(), "]");
+    }
+    return result;
+  }
+
+  // takes one completion if it is ready, never blocks
+  bool peek(::cp::io_completion& completion) noexcept
+  {
+#if CP_HAS_IO_URING
+    if (backend::io_uring == backend_) return peek_io_uring(completion);
+#endif
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pop_completion(completion);
+  }
+
+  // blocks until one completion is ready and takes it
+  void wait(::cp::io_completion& completion, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT_MSG(in_flight_ > 0, "nothing to wait for, submit requests first");
+
+#if CP_HAS_IO_URING
+    if (backend::io_uring == backend_)
+    {
+      while (!peek_io_uring(completion))
+      {
+        enter(0, 1, IORING_ENTER_GETEVENTS, ec);
+        if (CP_UNLIKELY(ec)) return;
+      }
+      return;
+    }
+#endif
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !done_.empty(); });
+    pop_completion(completion);
+  }
+
+  void wait(::cp::io_completion& completion)
+  {
+    std::error_code ec;
+    wait(completion, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "io_ring::wait in_flight: [", in_flight_, "]");
+    }
+  }
+
+  // buffers used by read_fixed and write_fixed, kernel pins them once instead of on every request
+  void register_buffers(const ::iovec* iov, unsigned count, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(iov);
+    CP_ASSERT(0 == registered_buffers_);
+
+#if CP_HAS_IO_URING
+    if (backend::io_uring == backend_)
+    {
+      register_op(IORING_REGISTER_BUFFERS, iov, count, ec);
+      if (CP_UNLIKELY(ec)) return;
+    }
+#endif
+    registered_buffers_ = count;
+  }
+
+  void register_buffers(const ::iovec* iov, unsigned count)
+  {
+    std::error_code ec;
+    register_buffers(iov, count, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "io_ring::register_buffers count: [", count, "]");
+    }
+  }
+
+  void unregister_buffers(std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+#if CP_HAS_IO_URING
+    if (backend::io_uring == backend_)
+    {
+      register_op(IORING_UNREGISTER_BUFFERS, nullptr, 0, ec);
+      if (CP_UNLIKELY(ec)) return;
+    }
+#endif
+    registered_buffers_ = 0;
+  }
+
+  void unregister_buffers()
+  {
+    std::error_code ec;
+    unregister_buffers(ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "io_ring::unregister_buffers");
+    }
+  }
+
+  // files referenced by fixed_file, kernel skips file descriptor lookup for them. descriptors must
+  // stay open while they are registered
+  void register_files(const int* fds, unsigned count, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(fds);
+    CP_ASSERT(files_.empty());
+
+#if CP_HAS_IO_URING
+    if (backend::io_uring == backend_)
+    {
+      register_op(IORING_REGISTER_FILES, fds, count, ec);
+      if (CP_UNLIKELY(ec)) return;
+    }
+#endif
+    files_.assign(fds, fds + count);
+  }
+
+  void register_files(const int* fds, unsigned count)
+  {
+    std::error_code ec;
+    register_files(fds, count, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "io_ring::register_files count: [", count, "]");
+    }
+  }
+
+  void unregister_files(std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+#if CP_HAS_IO_URING
+    if (backend::io_uring == backend_)
+    {
+      register_op(IORING_UNREGISTER_FILES, nullptr, 0, ec);
+      if (CP_UNLIKELY(ec)) return;
+    }
+#endif
+    files_.clear();
+  }
+
+  void unregister_files()
+  {
+    std::error_code ec;
+    unregister_files(ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "io_ring::unregister_files");
+    }
+  }
+
+private:
+  // io_uring is used when it is preferred and the kernel supports all opcodes used here, thread pool
+  // is used otherwise. errors other than missing support are reported
+  void open(unsigned entries, backend preferred, std::error_code& ec)
+  {
+    CP_ASSERT(entries > 0);
+
+#if CP_HAS_IO_URING
+    if (backend::io_uring == preferred)
+    {
+      setup_io_uring(entries, ec);
+      if (!ec) pending_.reserve(sq_entries_);
+      if (!ec || !is_unsupported(ec)) return;
+      ec.clear();
+      release_io_uring();
+    }
+#else
+    (void)preferred;
+#endif
+    backend_ = backend::thread_pool;
+    pool_.reset(new ::cp::thread_pool(std::min(entries, ::cp::thread_pool::default_size())));
+  }
+
+  void queue(::cp::detail::io_request const& request)
+  {
+    CP_ASSERT(!request.fixed_file || request.fd < int(files_.size()));
+    pending_.push_back(request);
+  }
+
+  // thread pool backend
+
+  bool pop_completion(::cp::io_completion& completion) noexcept
+  {
+    if (done_.empty()) return false;
+    completion = done_.front();
+    done_.pop_front();
+    --in_flight_;
+    return true;
+  }
+
+  std::size_t submit_thread_pool(unsigned wait_nr)
+  {
+    const std::size_t count = pending_.size();
+    for (::cp::detail::io_request const& request : pending_)
+    {
+      ++in_flight_;
+      pool_->post([this, request] {
+        const ::cp::io_completion completion = execute(request);
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          done_.push_back(completion);
+        }
+        cv_.notify_one();
+      });
+    }
+    pending_.clear();
+
+    if (wait_nr > 0)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this, wait_nr] { return done_.size() >= wait_nr; });
+    }
+    return count;
+  }
+
+  ::cp::io_completion execute(::cp::detail::io_request const& r) const noexcept
+  {
+    using ::cp::detail::io_opcode;
+    const int fd = r.fixed_file ? files_[r.fd] : r.fd;
+
+    std::int64_t result;
+    do
+    {
+      switch (r.op)
+      {
+      case io_opcode::read:
+      case io_opcode::read_fixed:
+        result = (-1 == r.offset) ? ::read(fd, r.buffer, r.length) : ::pread(fd, r.buffer, r.length, r.offset);
+        break;
+      case io_opcode::write:
+      case io_opcode::write_fixed:
+        result = (-1 == r.offset) ? ::write(fd, r.buffer, r.length) : ::pwrite(fd, r.buffer, r.length, r.offset);
+        break;
+      case io_opcode::fsync:
+        result = ::fsync(fd);
+        break;
+      case io_opcode::fdatasync:
+        result = ::fdatasync(fd);
+        break;
+      case io_opcode::openat:
+        result = ::openat(fd, r.path, r.flags, ::mode_t(r.mode));
+        break;
+      case io_opcode::statx:
+#if defined STATX_TYPE
+        result = ::statx(fd, r.path, r.flags, r.mode, static_cast<struct ::statx*>(r.buffer));
+#else
+        result = -1;
+        errno  = ENOSYS;
+#endif
+        break;
+      default:
+        result = -1;
+        errno  = EINVAL;
+      }
+    } while (-1 == result && EINTR == errno);
+
+    return ::cp::detail::make_io_completion(r.user_data, -1 == result ? -errno : result);
+  }
+
+#if CP_HAS_IO_URING
+  // io_uring backend, rings are shared with the kernel and accessed through raw syscalls
+
+  static bool is_unsupported(std::error_code const& ec) noexcept
+  {
+    return ec == std::errc::function_not_supported
+        || ec == std::errc::operation_not_permitted
+        || ec == std::errc::permission_denied
+        || ec == std::errc::not_supported;
+  }
+
+  static unsigned load_acquire(const unsigned* p) noexcept { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+  static void store_release(unsigned* p, unsigned v) noexcept { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+  void setup_io_uring(unsigned entries, std::error_code& ec)
+  {
+    ::io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    const int fd = int(::syscall(__NR_io_uring_setup, entries, &params));
+    if (CP_UNLIKELY(-1 == fd))
+    {
+      ec = ::cp::make_system_error_code();
+      return;
+    }
+    ring_fd_.reset(fd);
+
+    std::size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    std::size_t cq_size = params.cq_off.cqes  + params.cq_entries * sizeof(::io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) sq_size = cq_size = std::max(sq_size, cq_size);
+
+    const int prot  = PROT_READ | PROT_WRITE;
+    const int flags = MAP_SHARED | MAP_POPULATE;
+    sq_ring_ = ::cp::mmap(sq_size, prot, flags, ring_fd_, IORING_OFF_SQ_RING, ec);
+    if (CP_UNLIKELY(ec)) return;
+    if (!single_mmap)
+    {
+      cq_ring_ = ::cp::mmap(cq_size, prot, flags, ring_fd_, IORING_OFF_CQ_RING, ec);
+      if (CP_UNLIKELY(ec)) return;
+    }
+    sqes_ = ::cp::mmap(params.sq_entries * sizeof(::io_uring_sqe), prot, flags, ring_fd_, IORING_OFF_SQES, ec);
+    if (CP_UNLIKELY(ec)) return;
+
+    char* const sq = sq_ring_.get().as<char>();
+    char* const cq = single_mmap ? sq : cq_ring_.get().as<char>();
+
+    sq_head_    = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_    = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_    = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_   = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+    cq_head_    = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_    = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_    = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cq_entries_ = params.cq_entries;
+    cqes_       = reinterpret_cast<::io_uring_cqe*>(cq + params.cq_off.cqes);
+    sqe_array_  = sqes_.get().as<::io_uring_sqe>();
+
+    if (!probe_opcodes())
+    {
+      ec = ::cp::make_system_error_code(ENOSYS);
+      return;
+    }
+    backend_ = backend::io_uring;
+  }
+
+  void release_io_uring() noexcept
+  {
+    sqes_.reset();
+    cq_ring_.reset();
+    sq_ring_.reset();
+    ring_fd_.reset();
+  }
+
+  bool probe_opcodes() const
+  {
+    constexpr unsigned ops_count = 256;
+    std::vector<char> storage(sizeof(::io_uring_probe) + ops_count * sizeof(::io_uring_probe_op));
+    ::io_uring_probe* const probe = reinterpret_cast<::io_uring_probe*>(storage.data());
+
+    if (::syscall(__NR_io_uring_register, ring_fd_.get(), IORING_REGISTER_PROBE, probe, ops_count) < 0) return false;
+
+    for (unsigned op : { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED,
+                         IORING_OP_FSYNC, IORING_OP_OPENAT, IORING_OP_STATX })
+    {
+      if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+    }
+    return true;
+  }
+
+  void register_op(unsigned opcode, const void* arg, unsigned count, std::error_code& ec) const noexcept
+  {
+    const long status = ::syscall(__NR_io_uring_register, ring_fd_.get(), opcode, arg, count);
+    if (CP_UNLIKELY(status < 0)) ec = ::cp::make_system_error_code();
+  }
+
+  unsigned enter(unsigned to_submit, unsigned min_complete, unsigned flags, std::error_code& ec) noexcept
+  {
+    for (;;)
+    {
+      const long result = ::syscall(__NR_io_uring_enter, ring_fd_.get(), to_submit, min_complete, flags, nullptr, 0);
+      if (CP_LIKELY(result >= 0)) return unsigned(result);
+      if (EINTR == errno) continue;
+      ec = ::cp::make_system_error_code();
+      return 0;
+    }
+  }
+
+  static void prepare(::io_uring_sqe& sqe, ::cp::detail::io_request const& r) noexcept
+  {
+    using ::cp::detail::io_opcode;
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.fd        = r.fd;
+    sqe.user_data = r.user_data;
+    if (r.fixed_file) sqe.flags |= IOSQE_FIXED_FILE;
+
+    switch (r.op)
+    {
+    case io_opcode::read:
+    case io_opcode::write:
+    case io_opcode::read_fixed:
+    case io_opcode::write_fixed:
+      sqe.opcode = io_opcode::read       == r.op ? IORING_OP_READ
+                 : io_opcode::write      == r.op ? IORING_OP_WRITE
+                 : io_opcode::read_fixed == r.op ? IORING_OP_READ_FIXED
+                 :                                 IORING_OP_WRITE_FIXED;
+      sqe.addr      = std::uintptr_t(r.buffer);
+      sqe.len       = std::uint32_t(r.length);
+      sqe.off       = std::uint64_t(std::int64_t(r.offset));
+      sqe.buf_index = std::uint16_t(r.buffer_index);
+      break;
+    case io_opcode::fsync:
+      sqe.opcode = IORING_OP_FSYNC;
+      break;
+    case io_opcode::fdatasync:
+      sqe.opcode      = IORING_OP_FSYNC;
+      sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+      break;
+    case io_opcode::openat:
+      sqe.opcode     = IORING_OP_OPENAT;
+      sqe.addr       = std::uintptr_t(r.path);
+      sqe.len        = r.mode;
+      sqe.open_flags = std::uint32_t(r.flags);
+      break;
+    case io_opcode::statx:
+      sqe.opcode      = IORING_OP_STATX;
+      sqe.addr        = std::uintptr_t(r.path);
+      sqe.len         = r.mode;
+      sqe.off         = std::uintptr_t(r.buffer);
+      sqe.statx_flags = std::uint32_t(r.flags);
+      break;
+    }
+  }
+
+  unsigned cq_ready() const noexcept
+  {
+    return load_acquire(cq_tail_) - *cq_head_;
+  }
+
+  std::size_t submit_io_uring(unsigned wait_nr, std::error_code& ec)
+  {
+    CP_ASSERT_MSG(wait_nr <= cq_entries_, "completion ring can not hold wait_nr completions");
+
+    std::size_t submitted = 0;
+    std::size_t queued    = 0;
+    for (;;)
+    {
+      // copy as many pending requests as there is free space in the submission ring
+      unsigned tail = *sq_tail_;
+      while (queued < pending_.size() && tail - load_acquire(sq_head_) < sq_entries_)
+      {
+        const unsigned index = tail & sq_mask_;
+        prepare(sqe_array_[index], pending_[queued]);
+        sq_array_[index] = index;
+        ++tail;
+        ++queued;
+      }
+      store_release(sq_tail_, tail);
+
+      const unsigned to_submit    = tail - load_acquire(sq_head_);
+      const bool     all_queued   = queued == pending_.size();
+      const unsigned min_complete = all_queued ? wait_nr : 0;
+      if (0 == to_submit && (0 == min_complete || cq_ready() >= min_complete)) break;
+
+      const unsigned result = enter(to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0, ec);
+      submitted  += result;
+      in_flight_ += result;
+      if (CP_UNLIKELY(ec)) break;
+      if (all_queued && result == to_submit && cq_ready() >= min_complete) break;
+    }
+    // requests that were copied into the ring, but not consumed by the kernel because of an error,
+    // are still in the ring and will be submitted by the next call
+    in_flight_ += queued - submitted;
+    pending_.erase(pending_.begin(), pending_.begin() + queued);
+    return queued;
+  }
+
+  bool peek_io_uring(::cp::io_completion& completion) noexcept
+  {
+    const unsigned head = *cq_head_;
+    if (head == load_acquire(cq_tail_)) return false;
+
+    ::io_uring_cqe const& cqe = cqes_[head & cq_mask_];
+    completion = ::cp::detail::make_io_completion(cqe.user_data, cqe.res);
+    store_release(cq_head_, head + 1);
+    --in_flight_;
+    return true;
+  }
+
+  ::cp::file_descriptor ring_fd_;
+  ::cp::mapped_region   sq_ring_;
+  ::cp::mapped_region   cq_ring_;
+  ::cp::mapped_region   sqes_;
+  unsigned*             sq_head_    = nullptr;
+  unsigned*             sq_tail_    = nullptr;
+  unsigned              sq_mask_    = 0;
+  unsigned*             sq_array_   = nullptr;
+  unsigned              sq_entries_ = 0;
+  unsigned*             cq_head_    = nullptr;
+  unsigned*             cq_tail_    = nullptr;
+  unsigned              cq_mask_    = 0;
+  unsigned              cq_entries_ = 0;
+  ::io_uring_cqe*       cqes_       = nullptr;
+  ::io_uring_sqe*       sqe_array_  = nullptr;
+#endif
+
+  backend                               backend_            = backend::thread_pool;
+  std::vector<::cp::detail::io_request> pending_;
+  std::size_t                           in_flight_          = 0;
+  unsigned                              registered_buffers_ = 0;
+  std::vector<int>                      files_;
+
+  // thread pool backend, pool_ is declared last so that its workers are joined before the
+  // completion queue they write to is destroyed
+  std::mutex                            mutex_;
+  std::condition_variable               cv_;
+  std::deque<::cp::io_completion>       done_;
+  std::unique_ptr<::cp::thread_pool>    pool_;
+};
+
+} // namespace cp
@@ -0,0 +1,371 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cp {
+
+// span like view of mapped memory, it is also the native type of mapped_region
+struct memory_mapping
+{
+  void*       address;
+  std::size_t length;
+
+  std::byte*  data()  const noexcept { return static_cast<std::byte*>(address); }
+  std::size_t size()  const noexcept { return length; }
+  bool        empty() const noexcept { return 0 == length; }
+  std::byte*  begin() const noexcept { return data(); }
+  std::byte*  end()   const noexcept { return data() + length; }
+
+  template <typename T>
+  T* as() const noexcept { return static_cast<T*>(address); }
+
+  // view of the [offset, offset + count) part of the mapping
+  memory_mapping subview(std::size_t offset, std::size_t count) const noexcept
+  {
+    CP_ASSERT(offset <= length);
+    CP_ASSERT(count <= length - offset);
+    return memory_mapping{ data() + offset, count };
+  }
+
+  friend bool operator==(memory_mapping const& a, memory_mapping const& b) noexcept { return a.address == b.address && a.length == b.length; }
+  friend bool operator!=(memory_mapping const& a, memory_mapping const& b) noexcept { return !(a == b); }
+};
+
+struct mapped_region_traits
+{
+  // mmap never returns null address unless it is explicitly asked with MAP_FIXED
+  static constexpr memory_mapping invalid(void) noexcept { return memory_mapping{ nullptr, 0 }; }
+  static void close(memory_mapping m) noexcept
+  {
+    CP_ASSERT_MSG(m.address != nullptr, "must be a valid mapping");
+    ::munmap(m.address, m.length);
+  }
+};
+
+using mapped_region = ::cp::unique_handle<::cp::memory_mapping, ::cp::mapped_region_traits>;
+
+inline std::string to_string(::cp::mapped_region const& region)
+{
+  return region ? ::cp::concat(std::uintptr_t(region.get().address), ":", region.get().length) : "invalid";
+}
+
+inline std::to_chars_result to_chars(char* first, char* last, ::cp::mapped_region const& region) noexcept
+{
+  if (!region) return ::cp::to_chars(first, last, "invalid");
+
+  std::to_chars_result result = ::cp::to_chars(first, last, std::uintptr_t(region.get().address));
+  if (result.ec != std::errc()) return result;
+  result = ::cp::to_chars(result.ptr, last, ":");
+  if (result.ec != std::errc()) return result;
+  return ::cp::to_chars(result.ptr, last, region.get().length);
+}
+
+CP_DEFINE_SERIALIZATION_SPECIALIZATION(::cp::mapped_region);
+
+// access used by map_file, the whole file is mapped
+enum class map_access
+{
+  read_only,  // PROT_READ,              MAP_SHARED
+  read_write, // PROT_READ | PROT_WRITE, MAP_SHARED, changes are written back to the file
+  copy_on_write // PROT_READ | PROT_WRITE, MAP_PRIVATE, changes are never written back to the file
+};
+
+namespace detail {
+  CP_FORCE_INLINE
+  bool is_page_aligned(::off_t offset) noexcept
+  {
+    return 0 == (offset % ::sysconf(_SC_PAGESIZE));
+  }
+
+  CP_FORCE_INLINE
+  int map_access_prot(::cp::map_access access) noexcept
+  {
+    return ::cp::map_access::read_only == access ? PROT_READ : (PROT_READ | PROT_WRITE);
+  }
+
+  CP_FORCE_INLINE
+  int map_access_flags(::cp::map_access access) noexcept
+  {
+    return ::cp::map_access::copy_on_write == access ? MAP_PRIVATE : MAP_SHARED;
+  }
+}
+
+CP_FORCE_INLINE
+::cp::mapped_region mmap(
+  std::size_t length,
+  int prot,
+  int flags,
+  ::cp::file_descriptor const& fd,
+  ::off_t offset,
+  std::error_code& ec
+  ) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(length > 0);
+  CP_ASSERT(offset >= 0);
+  CP_ASSERT_MSG(::cp::detail::is_page_aligned(offset), "offset must be multiple of page size");
+
+  void* const address = ::mmap(nullptr, length, prot, flags, fd.get(), offset);
+  if (CP_UNLIKELY(MAP_FAILED == address))
+  {
+    ec = ::cp::make_system_error_code();
+    return ::cp::mapped_region();
+  }
+  return ::cp::mapped_region(::cp::memory_mapping{ address, length });
+}
+
+CP_FORCE_INLINE
+::cp::mapped_region mmap(std::size_t length, int prot, int flags, ::cp::file_descriptor const& fd, ::off_t offset)
+{
+  std::error_code ec;
+  ::cp::mapped_region result = ::cp::mmap(length, prot, flags, fd, offset, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "mmap length: [", length, "], prot: [", prot, "], flags: [", flags, "], fd: [", fd, "], offset: [", offset, "]");
+  }
+  return result;
+}
+
+CP_FORCE_INLINE
+::cp::mapped_region mmap(std::size_t length, int prot, int flags, std::error_code& ec) noexcept
+// anonymous mapping, MAP_ANONYMOUS is added to flags
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(length > 0);
+
+  void* const address = ::mmap(nullptr, length, prot, flags | MAP_ANONYMOUS, -1, 0);
+  if (CP_UNLIKELY(MAP_FAILED == address))
+  {
+    ec = ::cp::make_system_error_code();
+    return ::cp::mapped_region();
+  }
+  return ::cp::mapped_region(::cp::memory_mapping{ address, length });
+}
+
+CP_FORCE_INLINE
+::cp::mapped_region mmap(std::size_t length, int prot, int flags)
+// anonymous mapping, MAP_ANONYMOUS is added to flags
+{
+  std::error_code ec;
+  ::cp::mapped_region result = ::cp::mmap(length, prot, flags, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "mmap anonymous length: [", length, "], prot: [", prot, "], flags: [", flags, "]");
+  }
+  return result;
+}
+
+CP_FORCE_INLINE
+::cp::mapped_region map_file(::cp::file_descriptor const& fd, ::cp::map_access access, std::error_code& ec) noexcept
+// maps the whole file, empty file can not be mapped and EINVAL is returned for it
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+
+  ::cp::file_info info;
+  ::cp::fstat(fd, info, ec);
+  if (CP_UNLIKELY(ec)) return ::cp::mapped_region();
+  if (CP_UNLIKELY(0 == info.size()))
+  {
+    ec = ::cp::make_system_error_code(EINVAL);
+    return ::cp::mapped_region();
+  }
+
+  return ::cp::mmap(
+    std::size_t(info.size()),
+    ::cp::detail::map_access_prot(access),
+    ::cp::detail::map_access_flags(access),
+    fd,
+    0,
+    ec
+  );
+}
+
+CP_FORCE_INLINE
+::cp::mapped_region map_file(::cp::file_descriptor const& fd, ::cp::map_access access)
+{
+  std::error_code ec;
+  ::cp::mapped_region result = ::cp::map_file(fd, access, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "map_file fd: [", fd, "], access: [", int(access), "]");
+  }
+  return result;
+}
+
+CP_FORCE_INLINE
+::cp::mapped_region map_file(::cp::file_descriptor const& fd, ::cp::map_access access, ::off_t offset, std::size_t length, std::error_code& ec) noexcept
+// maps [offset, offset + length) part of the file, offset must be multiple of page size
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+
+  return ::cp::mmap(length, ::cp::detail::map_access_prot(access), ::cp::detail::map_access_flags(access), fd, offset, ec);
+}
+
+CP_FORCE_INLINE
+::cp::mapped_region map_file(::cp::file_descriptor const& fd, ::cp::map_access access, ::off_t offset, std::size_t length)
+{
+  std::error_code ec;
+  ::cp::mapped_region result = ::cp::map_file(fd, access, offset, length, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "map_file fd: [", fd, "], access: [", int(access), "], offset: [", offset, "], length: [", length, "]");
+  }
+  return result;
+}
+
+CP_FORCE_INLINE
+void munmap(::cp::mapped_region& region, std::error_code& ec) noexcept
+// unmaps region and reports error, destructor of mapped_region ignores it
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(region);
+
+  const ::cp::memory_mapping m = region.release();
+  const int status = ::munmap(m.address, m.length);
+  if (CP_UNLIKELY(-1 == status)) ec = ::cp::make_system_error_code();
+}
+
+CP_FORCE_INLINE
+void munmap(::cp::mapped_region& region)
+{
+  std::error_code ec;
+  const ::cp::memory_mapping m = region.get();
+  ::cp::munmap(region, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "munmap address: [", std::uintptr_t(m.address), "], length: [", m.length, "]");
+  }
+}
+
+CP_FORCE_INLINE
+void madvise(::cp::mapped_region const& region, std::size_t offset, std::size_t length, int advice, std::error_code& ec) noexcept
+// offset must be multiple of page size
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(region);
+  CP_ASSERT(offset <= region.get().length && length <= region.get().length - offset);
+  CP_ASSERT_MSG(::cp::detail::is_page_aligned(offset), "offset must be multiple of page size");
+
+  const int status = ::madvise(region.get().data() + offset, length, advice);
+  if (CP_UNLIKELY(-1 == status)) ec = ::cp::make_system_error_code();
+}
+
+CP_FORCE_INLINE
+void madvise(::cp::mapped_region const& region, std::size_t offset, std::size_t length, int advice)
+{
+  std::error_code ec;
+  ::cp::madvise(region, offset, length, advice, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "madvise region: [", region, "], offset: [", offset, "], length: [", length, "], advice: [", advice, "]");
+  }
+}
+
+CP_FORCE_INLINE
+void madvise(::cp::mapped_region const& region, int advice, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  ::cp::madvise(region, 0, region.get().length, advice, ec);
+}
+
+CP_FORCE_INLINE
+void madvise(::cp::mapped_region const& region, int advice)
+{
+  ::cp::madvise(region, 0, region.get().length, advice);
+}
+
+CP_FORCE_INLINE
+void msync(::cp::mapped_region const& region, std::size_t offset, std::size_t length, int flags, std::error_code& ec) noexcept
+// offset must be multiple of page size
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(region);
+  CP_ASSERT(offset <= region.get().length && length <= region.get().length - offset);
+  CP_ASSERT_MSG(::cp::detail::is_page_aligned(offset), "offset must be multiple of page size");
+
+  const int status = ::msync(region.get().data() + offset, length, flags);
+  if (CP_UNLIKELY(-1 == status)) ec = ::cp::make_system_error_code();
+}
+
+CP_FORCE_INLINE
+void msync(::cp::mapped_region const& region, std::size_t offset, std::size_t length, int flags)
+{
+  std::error_code ec;
+  ::cp::msync(region, offset, length, flags, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "msync region: [", region, "], offset: [", offset, "], length: [", length, "], flags: [", flags, "]");
+  }
+}
+
+CP_FORCE_INLINE
+void msync(::cp::mapped_region const& region, int flags, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  ::cp::msync(region, 0, region.get().length, flags, ec);
+}
+
+CP_FORCE_INLINE
+void msync(::cp::mapped_region const& region, int flags)
+{
+  ::cp::msync(region, 0, region.get().length, flags);
+}
+
+#if defined _GNU_SOURCE
+
+CP_FORCE_INLINE
+void mremap(::cp::mapped_region& region, std::size_t new_length, int flags, std::error_code& ec) noexcept
+// region is updated in place, without MREMAP_MAYMOVE in flags mapping can only grow if the
+// address space after it is free. growing file mapping beyond the end of the file gives
+// SIGBUS on access to pages past the end of the file
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(region);
+  CP_ASSERT(new_length > 0);
+
+  const ::cp::memory_mapping old = region.get();
+  void* const address = ::mremap(old.address, old.length, new_length, flags);
+  if (CP_UNLIKELY(MAP_FAILED == address))
+  {
+    ec = ::cp::make_system_error_code();
+    return;
+  }
+  // old mapping is already gone, it must not be unmapped again
+  region.release();
+  region.reset(::cp::memory_mapping{ address, new_length });
+}
+
+CP_FORCE_INLINE
+void mremap(::cp::mapped_region& region, std::size_t new_length, int flags)
+{
+  std::error_code ec;
+  ::cp::mremap(region, new_length, flags, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "mremap region: [", region, "], new_length: [", new_length, "], flags: [", flags, "]");
+  }
+}
+
+#endif
+
+} // namespace cp
@@ -0,0 +1,508 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+#include "directory_iterator.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && defined(SYS_getdents64)
+
+namespace cp {
+
+enum class walk_action
+{
+  continue_walk,
+  skip_subtree,   // do not descend into the directory, same as continue_walk for other entries
+  stop
+};
+
+struct walk_entry
+{
+  std::string_view       path;    // relative to the root, "dir/name"
+  std::string_view       name;
+  unsigned               depth;   // 1 for entries of the root directory
+  ::cp::file_info const& info;    // fstatat with AT_SYMLINK_NOFOLLOW, see walk_options::stat_entries
+  std::error_code        ec;      // fstatat of the entry failed, or it is a directory that could not be read
+};
+
+struct walk_options
+{
+  unsigned threads        = ::cp::thread_pool::default_size();
+  unsigned max_open_files = 256;    // directory descriptors open at once, root included
+  bool     ordered        = false;  // visitor is called on the calling thread, entries sorted by name, pre-order
+  bool     stat_entries   = true;   // when false info holds only file type and inode number reported by getdents64
+};
+
+namespace detail {
+
+  // open directory, subdirectories hold it while they are queued so that they can be opened
+  // with openat relative to it instead of relative to the root
+  struct walk_dir
+  {
+    walk_dir(::cp::file_descriptor fd, std::atomic<unsigned>& open_files) noexcept
+      : fd(std::move(fd)), open_files(open_files)
+    { }
+
+    ~walk_dir() { --open_files; }
+
+    ::cp::file_descriptor  fd;
+    std::atomic<unsigned>& open_files;
+  };
+
+  struct walk_listing;
+
+  struct walk_item
+  {
+    std::string                   name;
+    ::cp::file_info               info;
+    std::error_code               ec;
+    std::shared_ptr<walk_listing> child;
+  };
+
+  // sorted content of one directory, read by a worker ahead of the visit in ordered mode
+  struct walk_listing
+  {
+    std::vector<walk_item>    items;
+    std::error_code           ec;
+    std::shared_ptr<walk_dir> dir;
+    bool                      ready = false;
+    std::atomic<bool>         cancelled{ false };
+  };
+
+  struct walk_task
+  {
+    std::shared_ptr<walk_dir>     parent;         // null when the directory is opened relative to the root
+    std::string                   path;           // relative to the root, empty for the root itself
+    std::size_t                   name_offset;
+    unsigned                      depth;
+    ::cp::file_info               info;
+    std::shared_ptr<walk_listing> listing;        // ordered mode only
+  };
+
+  // every worker has its own deque, it pushes and pops subdirectories at the back and idle
+  // workers steal from the front of the others, where the oldest and usually largest subtrees are
+  template <typename Visitor>
+  class walker
+  {
+  public:
+    walker(Visitor& visitor, ::cp::walk_options const& options, ::cp::file_descriptor root_fd)
+      : visitor_(visitor)
+      , options_(options)
+      , queues_(options.threads + 1)
+    {
+      open_files_ = 1;
+      root_ = std::make_shared<walk_dir>(std::move(root_fd), open_files_);
+    }
+
+    void run(std::error_code& ec)
+    {
+      const unsigned caller  = options_.threads;
+      const unsigned workers = options_.ordered ? options_.threads : options_.threads - 1;
+
+      walk_task root{ nullptr, std::string(), 0, 0, ::cp::file_info(), nullptr };
+      std::shared_ptr<walk_listing> listing;
+      if (options_.ordered)
+      {
+        listing      = std::make_shared<walk_listing>();
+        root.listing = listing;
+      }
+      else
+      {
+        closing_ = true;
+      }
+      push(caller, std::move(root));
+
+      {
+        joiner guard{ *this, {} };
+        guard.threads.reserve(workers);
+        for (unsigned i = 0; i < workers; ++i) {
+          guard.threads.emplace_back([this, i] { worker_loop(i); });
+        }
+
+        if (options_.ordered)
+        {
+          wait_ready(*listing);
+          if (listing->ec) root_ec_ = listing->ec;
+          std::string path;
+          visit_listing(*listing, path, 1);
+        }
+        else
+        {
+          worker_loop(caller);
+        }
+      }
+
+      if (exception_) std::rethrow_exception(exception_);
+      ec = root_ec_;
+    }
+
+  private:
+    struct worker_queue
+    {
+      std::mutex            mutex;
+      std::deque<walk_task> tasks;
+    };
+
+    // stops workers and joins them, also when the visitor throws on the calling thread
+    struct joiner
+    {
+      ~joiner()
+      {
+        {
+          std::lock_guard<std::mutex> lock(self.mutex_);
+          self.stop_    = true;
+          self.closing_ = true;
+        }
+        self.work_cv_.notify_all();
+        for (std::thread& t : threads) t.join();
+      }
+
+      walker&                  self;
+      std::vector<std::thread> threads;
+    };
+
+    void push(unsigned self, walk_task&& task)
+    {
+      ++outstanding_;
+      {
+        std::lock_guard<std::mutex> lock(queues_[self].mutex);
+        queues_[self].tasks.push_back(std::move(task));
+      }
+      ++queued_;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+      }
+      work_cv_.notify_one();
+    }
+
+    bool pop(unsigned index, walk_task& task, bool back)
+    {
+      worker_queue& queue = queues_[index];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) return false;
+      if (back) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+      --queued_;
+      return true;
+    }
+
+    bool next_task(unsigned self, walk_task& task)
+    {
+      const unsigned count = unsigned(queues_.size());
+      for (;;)
+      {
+        if (pop(self, task, true)) return true;
+        for (unsigned i = 1; i < count; ++i) {
+          if (pop((self + i) % count, task, false)) return true;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_cv_.wait(lock, [this] { return queued_ > 0 || (closing_ && 0 == outstanding_); });
+        if (0 == queued_ && closing_ && 0 == outstanding_) return false;
+      }
+    }
+
+    void finish_task()
+    {
+      if (0 == --outstanding_)
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+        }
+        work_cv_.notify_all();
+      }
+    }
+
+    void worker_loop(unsigned self) noexcept
+    {
+      try
+      {
+        ::cp::directory_buffer buffer;
+        walk_task task;
+        while (next_task(self, task))
+        {
+          if (options_.ordered) {
+            list(task, buffer);
+          } else if (!stop_) {
+            try { visit_directory(self, task, buffer); } catch (...) { fail(std::current_exception()); }
+          }
+          // parent directory is released before the task is counted as finished
+          task = walk_task();
+          finish_task();
+        }
+      }
+      catch (...)
+      {
+        fail(std::current_exception());
+      }
+    }
+
+    void fail(std::exception_ptr e) noexcept
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!exception_) exception_ = e;
+      stop_ = true;
+    }
+
+    bool retain_directory() const noexcept
+    {
+      return open_files_ + options_.threads <= options_.max_open_files;
+    }
+
+    std::shared_ptr<walk_dir> open(walk_task const& task, std::error_code& ec)
+    {
+      if (task.path.empty()) return root_;
+
+      const int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+      ::cp::file_descriptor fd = task.parent
+        ? ::cp::openat(task.parent->fd, task.path.c_str() + task.name_offset, flags, ec)
+        : ::cp::openat(root_->fd, task.path.c_str(), flags, ec);
+      if (ec) return nullptr;
+
+      ++open_files_;
+      return std::make_shared<walk_dir>(std::move(fd), open_files_);
+    }
+
+    void stat_entry(::cp::file_descriptor const& dir_fd, ::cp::directory_entry const& entry, ::cp::file_info& info, std::error_code& ec) const noexcept
+    {
+      if (!options_.stat_entries && !entry.is_type_unknown())
+      {
+        std::memset(&info, 0, sizeof(info));
+        info.st_mode = DTTOIF(entry.type);
+        info.st_ino  = entry.ino;
+        return;
+      }
+      ::cp::fstatat(dir_fd, entry.c_str(), info, AT_SYMLINK_NOFOLLOW, ec);
+    }
+
+    bool visit(std::string_view path, std::size_t name_offset, unsigned depth, ::cp::file_info const& info, std::error_code ec, ::cp::walk_action& action)
+    {
+      action = visitor_(::cp::walk_entry{ path, path.substr(name_offset), depth, info, ec });
+      if (::cp::walk_action::stop != action) return true;
+      stop_ = true;
+      return false;
+    }
+
+    // directory could not be opened or read, reported with a second visit of the directory
+    void report(walk_task const& task, std::error_code ec)
+    {
+      if (task.path.empty()) {
+        root_ec_ = ec;
+        return;
+      }
+      ::cp::walk_action action;
+      visit(task.path, task.name_offset, task.depth, task.info, ec, action);
+    }
+
+    // unordered mode, entries are visited as they are read
+    void visit_directory(unsigned self, walk_task const& task, ::cp::directory_buffer& buffer)
+    {
+      std::error_code ec;
+      const std::shared_ptr<walk_dir> dir = open(task, ec);
+      if (ec) return report(task, ec);
+
+      std::string path = task.path;
+      if (!path.empty()) path += '/';
+      const std::size_t name_offset = path.size();
+
+      std::vector<walk_task> subdirs;
+      for (::cp::directory_iterator it(dir->fd, buffer, ec), end; !ec && it != end; it.increment(ec))
+      {
+        path.resize(name_offset);
+        path.append(it->name);
+
+        ::cp::file_info info;
+        std::error_code entry_ec;
+        stat_entry(dir->fd, *it, info, entry_ec);
+
+        ::cp::walk_action action;
+        if (!visit(path, name_offset, task.depth + 1, info, entry_ec, action) || stop_) return;
+        if (::cp::walk_action::continue_walk == action && !entry_ec && info.is_directory()) {
+          subdirs.push_back(walk_task{ nullptr, path, name_offset, task.depth + 1, info, nullptr });
+        }
+      }
+      if (ec) report(task, ec);
+
+      // pushed in reverse so that the first subdirectory is popped first
+      const bool retain = retain_directory();
+      for (auto it = subdirs.rbegin(); it != subdirs.rend(); ++it)
+      {
+        if (retain) it->parent = dir;
+        push(self, std::move(*it));
+      }
+    }
+
+    // ordered mode, worker reads and sorts the listing, the calling thread visits it
+    void list(walk_task const& task, ::cp::directory_buffer& buffer) noexcept
+    {
+      walk_listing& listing = *task.listing;
+      try
+      {
+        if (!stop_ && !listing.cancelled) read_listing(task, listing, buffer);
+      }
+      catch (...)
+      {
+        fail(std::current_exception());
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listing.ready = true;
+      }
+      ready_cv_.notify_one();
+    }
+
+    void read_listing(walk_task const& task, walk_listing& listing, ::cp::directory_buffer& buffer)
+    {
+      std::error_code ec;
+      std::shared_ptr<walk_dir> dir = open(task, ec);
+      if (ec)
+      {
+        listing.ec = ec;
+        return;
+      }
+
+      for (::cp::directory_iterator it(dir->fd, buffer, ec), end; !ec && it != end; it.increment(ec))
+      {
+        walk_item& item = listing.items.emplace_back();
+        item.name.assign(it->name);
+        stat_entry(dir->fd, *it, item.info, item.ec);
+      }
+      listing.ec = ec;
+
+      std::sort(listing.items.begin(), listing.items.end(),
+        [](walk_item const& a, walk_item const& b) { return a.name < b.name; });
+      if (retain_directory()) listing.dir = std::move(dir);
+    }
+
+    void wait_ready(walk_listing const& listing)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_cv_.wait(lock, [&listing] { return listing.ready; });
+    }
+
+    bool visit_listing(walk_listing& listing, std::string& path, unsigned depth)
+    {
+      const unsigned    caller      = options_.threads;
+      const std::size_t name_offset = path.size();
+
+      // subdirectories are read by workers while this directory is visited
+      for (walk_item& item : listing.items)
+      {
+        if (item.ec || !item.info.is_directory()) continue;
+        item.child = std::make_shared<walk_listing>();
+        push(caller, walk_task{ listing.dir, path + item.name, name_offset, depth, item.info, item.child });
+      }
+      listing.dir.reset();
+
+      for (walk_item& item : listing.items)
+      {
+        path.resize(name_offset);
+        path += item.name;
+
+        ::cp::walk_action action;
+        if (!visit(path, name_offset, depth, item.info, item.ec, action)) return false;
+
+        const std::shared_ptr<walk_listing> child = std::move(item.child);
+        if (!child) continue;
+        if (::cp::walk_action::skip_subtree == action)
+        {
+          child->cancelled = true;
+          continue;
+        }
+
+        wait_ready(*child);
+        if (child->ec && !visit(path, name_offset, depth, item.info, child->ec, action)) return false;
+
+        path += '/';
+        if (!visit_listing(*child, path, depth + 1)) return false;
+      }
+      return true;
+    }
+
+    Visitor&                         visitor_;
+    ::cp::walk_options const         options_;
+    std::atomic<unsigned>            open_files_{ 0 };
+    std::shared_ptr<walk_dir>        root_;
+    std::vector<worker_queue>        queues_;
+    std::atomic<std::size_t>         queued_{ 0 };
+    std::atomic<std::size_t>         outstanding_{ 0 };
+    std::atomic<bool>                closing_{ false };
+    std::atomic<bool>                stop_{ false };
+    std::mutex                       mutex_;
+    std::condition_variable          work_cv_;
+    std::condition_variable          ready_cv_;
+    std::exception_ptr               exception_;
+    std::error_code                  root_ec_;
+  };
+} // namespace detail
+
+// walks the tree below root on options.threads threads, directories are opened with openat relative
+// to their parent while the descriptor budget allows and relative to the root otherwise. symbolic
+// links are not followed. visitor is called as walk_action(cp::walk_entry const&) for every entry
+// except the root; in unordered mode concurrently from many threads, in ordered mode only from the
+// calling thread. ec reports errors of the root directory, exceptions thrown by the visitor are
+// rethrown after all threads are joined
+template <typename Visitor>
+void parallel_walk(const char* root, Visitor&& visitor, ::cp::walk_options const& options, std::error_code& ec)
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(root);
+  CP_ASSERT(options.threads > 0);
+  CP_ASSERT(options.max_open_files > options.threads);
+
+  ::cp::file_descriptor root_fd = ::cp::open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC, ec);
+  if (CP_UNLIKELY(ec)) return;
+
+  ::cp::detail::walker<std::remove_reference_t<Visitor>> walker(visitor, options, std::move(root_fd));
+  walker.run(ec);
+}
+
+template <typename Visitor>
+void parallel_walk(const char* root, Visitor&& visitor, std::error_code& ec)
+{
+  ::cp::parallel_walk(root, visitor, ::cp::walk_options(), ec);
+}
+
+template <typename Visitor>
+void parallel_walk(const char* root, Visitor&& visitor, ::cp::walk_options const& options)
+{
+  std::error_code ec;
+  ::cp::parallel_walk(root, visitor, options, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "parallel_walk root: [", root, "], threads: [", options.threads, "], ordered: [", options.ordered ? "true" : "false", "]");
+  }
+}
+
+template <typename Visitor>
+void parallel_walk(const char* root, Visitor&& visitor)
+{
+  ::cp::parallel_walk(root, visitor, ::cp::walk_options());
+}
+
+} // namespace cp
+
+#endif
@@ -0,0 +1,263 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <limits.h>
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+namespace cp {
+
+// lexical path helpers, they never touch the file system and never modify or copy the path
+
+// directory part, as dirname(3) would return it: "/a/b" -> "/a", "a" -> ".", "/" -> "/",
+// trailing slashes are ignored. returned view points into path or to a literal
+inline
+std::string_view path_parent(std::string_view path) noexcept
+{
+  std::size_t end = path.size();
+  while (end > 1 && '/' == path[end - 1]) --end;            // trailing slashes
+  while (end > 0 && '/' != path[end - 1]) --end;            // last component
+  if (0 == end) return std::string_view(".", 1);
+  while (end > 1 && '/' == path[end - 1]) --end;            // slashes before it
+  return path.substr(0, end);
+}
+
+// last component, as basename(3) would return it: "/a/b/" -> "b", "/" -> "/", "" -> ""
+inline
+std::string_view path_filename(std::string_view path) noexcept
+{
+  std::size_t end = path.size();
+  while (end > 1 && '/' == path[end - 1]) --end;
+  if (1 == end && '/' == path[0]) return path.substr(0, 1);
+  std::size_t first = end;
+  while (first > 0 && '/' != path[first - 1]) --first;
+  return path.substr(first, end - first);
+}
+
+// nul terminated path stored in the object, Capacity includes the terminator. operations that
+// would make the path longer fail with ENAMETOOLONG and leave it unchanged. converts to
+// const char*, so it can be passed to every wrapper that takes a path
+template <std::size_t Capacity>
+class basic_path_buffer
+{
+  static_assert(Capacity >= 2);
+
+public:
+  static constexpr std::size_t capacity = Capacity;
+
+  basic_path_buffer() noexcept { data_[0] = '\0'; }
+
+  basic_path_buffer(std::string_view path, std::error_code& ec) noexcept
+  {
+    data_[0] = '\0';
+    assign(path, ec);
+  }
+
+  explicit basic_path_buffer(std::string_view path)
+  {
+    data_[0] = '\0';
+    assign(path);
+  }
+
+  basic_path_buffer(basic_path_buffer const& other) noexcept
+    : size_(other.size_)
+  {
+    std::memcpy(data_, other.data_, size_ + 1);
+  }
+
+  basic_path_buffer& operator = (basic_path_buffer const& other) noexcept
+  {
+    size_ = other.size_;
+    std::memmove(data_, other.data_, size_ + 1);
+    return *this;
+  }
+
+  void assign(std::string_view path, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    if (CP_UNLIKELY(path.size() >= Capacity))
+    {
+      ec = std::make_error_code(std::errc::filename_too_long);
+      return;
+    }
+    // path may point into this buffer
+    std::memmove(data_, path.data(), path.size());
+    size_ = path.size();
+    data_[size_] = '\0';
+  }
+
+  void assign(std::string_view path)
+  {
+    std::error_code ec;
+    assign(path, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "path_buffer::assign size: [", path.size(), "], capacity: [", Capacity, "]");
+    }
+  }
+
+  // appends component with a single slash between, absolute component replaces the path
+  basic_path_buffer& join(std::string_view component, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    if (!component.empty() && '/' == component[0])
+    {
+      assign(component, ec);
+      return *this;
+    }
+    if (component.empty()) return *this;
+
+    const bool slash = 0 != size_ && '/' != data_[size_ - 1];
+    const std::size_t size = size_ + (slash ? 1 : 0) + component.size();
+    if (CP_UNLIKELY(size >= Capacity))
+    {
+      ec = std::make_error_code(std::errc::filename_too_long);
+      return *this;
+    }
+    if (slash) data_[size_] = '/';
+    std::memmove(data_ + size - component.size(), component.data(), component.size());
+    size_ = size;
+    data_[size_] = '\0';
+    return *this;
+  }
+
+  basic_path_buffer& join(std::string_view component)
+  {
+    std::error_code ec;
+    join(component, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "path_buffer::join path: [", data_, "], component size: [", component.size(), "]");
+    }
+    return *this;
+  }
+
+  // removes ".", empty components and trailing slashes, and resolves ".." against the
+  // component before it. ".." at the root stays at the root, leading ".." of a relative path is
+  // kept. purely lexical, so "a/link/.." becomes "a" even when link is a symbolic link. empty
+  // path becomes "."
+  basic_path_buffer& normalize() noexcept
+  {
+    const bool absolute = 0 != size_ && '/' == data_[0];
+    std::size_t out  = absolute ? 1 : 0;   // end of normalized part
+    std::size_t keep = out;                // components before it can not be removed by ".."
+    std::size_t in   = 0;
+
+    while (in < size_)
+    {
+      while (in < size_ && '/' == data_[in]) ++in;
+      std::size_t end = in;
+      while (end < size_ && '/' != data_[end]) ++end;
+      const std::size_t length = end - in;
+
+      if (0 == length || (1 == length && '.' == data_[in]))
+      {
+        // nothing to add
+      }
+      else if (2 == length && '.' == data_[in] && '.' == data_[in + 1])
+      {
+        if (out > keep)
+        {
+          // drop the last component together with the slash before it
+          while (out > keep && '/' != data_[out - 1]) --out;
+          if (out > keep) --out;
+          if (absolute && 0 == out) out = 1;
+        }
+        else if (!absolute)
+        {
+          if (out > 0) data_[out++] = '/';
+          data_[out++] = '.';
+          data_[out++] = '.';
+          keep = out;
+        }
+      }
+      else
+      {
+        if (out > (absolute ? 1 : 0)) data_[out++] = '/';
+        std::memmove(data_ + out, data_ + in, length);
+        out += length;
+      }
+      in = end;
+    }
+
+    if (0 == out) data_[out++] = '.';
+    size_ = out;
+    data_[size_] = '\0';
+    return *this;
+  }
+
+  // replaces the path with its parent
+  basic_path_buffer& to_parent() noexcept
+  {
+    const std::string_view parent = ::cp::path_parent(view());
+    if (parent.data() != data_)
+    {
+      // "." literal
+      data_[0] = '.';
+      size_ = 1;
+    }
+    else size_ = parent.size();
+    data_[size_] = '\0';
+    return *this;
+  }
+
+  std::string_view parent()   const noexcept { return ::cp::path_parent(view());   }
+  std::string_view filename() const noexcept { return ::cp::path_filename(view()); }
+
+  std::string_view view()   const noexcept { return std::string_view(data_, size_); }
+  const char*      c_str()  const noexcept { return data_; }
+  std::size_t      size()   const noexcept { return size_; }
+  bool             empty()  const noexcept { return 0 == size_; }
+  bool             is_absolute() const noexcept { return 0 != size_ && '/' == data_[0]; }
+
+  operator const char* () const noexcept { return data_; }
+
+  // for functions that fill the buffer, such as realpath and readlink. size must be set after
+  char*       data()        noexcept { return data_; }
+  void        resize(std::size_t size) noexcept
+  {
+    CP_ASSERT(size < Capacity);
+    size_ = size;
+    data_[size_] = '\0';
+  }
+
+private:
+  std::size_t size_ = 0;
+  char        data_[Capacity];
+};
+
+#if defined PATH_MAX
+using path_buffer = ::cp::basic_path_buffer<PATH_MAX>;
+
+// realpath into a path buffer, nothing is allocated
+CP_FORCE_INLINE
+void realpath(const char* pathname, ::cp::path_buffer& resolved, std::error_code& ec) noexcept
+{
+  if (::cp::realpath(pathname, resolved.data(), ec)) resolved.resize(std::strlen(resolved.data()));
+}
+
+CP_FORCE_INLINE
+void realpath(const char* pathname, ::cp::path_buffer& resolved)
+{
+  std::error_code ec;
+  ::cp::realpath(pathname, resolved, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "realpath, pathname: [", pathname, "]");
+  }
+}
+#endif
+
+} // namespace cp
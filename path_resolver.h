@@ -0,0 +1,422 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+#include "path_buffer.h"
+
+#include <limits.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#if (_POSIX_C_SOURCE >= 200809L) && defined(O_PATH)
+
+namespace cp {
+
+// realpath that remembers what it has seen. path is walked one component at a time with fstatat
+// and readlinkat relative to directory descriptors kept open for the directories passed on the
+// way, so a component is never looked up by its full path. type of every component and targets
+// of symbolic links are cached by canonical path, next resolve that goes through the same
+// directories makes no system calls for them. the cache does not notice changes of the file system
+// by itself, call invalidate after changing it, or set revalidate to check the modification time of
+// every directory passed, which costs one fstat per directory instead of fstatat and readlinkat
+// per component. safe to use from many threads
+class path_resolver
+{
+  path_resolver(path_resolver const&) = delete;
+  path_resolver& operator = (path_resolver const&) = delete;
+
+public:
+  struct options
+  {
+    // check modification time of directories on every pass, cached content of a changed directory
+    // is dropped. changes made within the timestamp granularity of the file system can be missed
+    bool        revalidate           = false;
+
+    // directories kept open, deeper ones are looked up by full path when the limit is reached
+    std::size_t max_open_directories = 256;
+
+    // cached components, everything is dropped when the limit is reached
+    std::size_t max_entries          = 64 * 1024;
+  };
+
+  struct statistics
+  {
+    std::uint64_t hits    = 0;   // components found in the cache
+    std::uint64_t misses  = 0;   // components looked up with fstatat
+    std::uint64_t dropped = 0;   // cached components dropped by invalidation
+  };
+
+  path_resolver(options const& opts, std::error_code& ec)
+    : options_(opts)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    open_root(ec);
+  }
+
+  explicit path_resolver(options const& opts)
+    : options_(opts)
+  {
+    std::error_code ec;
+    open_root(ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "path_resolver open: [/]");
+    }
+  }
+
+  path_resolver() : path_resolver(options()) { }
+
+  // canonical absolute path of pathname, same as realpath(3). relative pathname is resolved against
+  // the current working directory
+  void resolve(const char* pathname, std::string& resolved, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(pathname);
+
+    resolved.clear();
+    if (CP_UNLIKELY('\0' == pathname[0]))
+    {
+      ec = std::make_error_code(std::errc::no_such_file_or_directory);
+      return;
+    }
+
+    // rest of the path, targets of symbolic links are put in front of it
+    std::string pending;
+    if ('/' != pathname[0])
+    {
+      ::cp::path_buffer cwd;
+      if (nullptr == ::cp::getcwd(cwd.data(), ::cp::path_buffer::capacity, ec)) return;
+      cwd.resize(std::strlen(cwd.data()));
+      pending.reserve(cwd.size() + 1 + std::strlen(pathname));
+      pending.append(cwd.view()).append(1, '/');
+    }
+    pending.append(pathname);
+    walk(pending, resolved, ec);
+  }
+
+  void resolve(const char* pathname, std::string& resolved)
+  {
+    std::error_code ec;
+    resolve(pathname, resolved, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "path_resolver::resolve pathname: [", pathname, "]");
+    }
+  }
+
+#if defined PATH_MAX
+  void resolve(const char* pathname, ::cp::path_buffer& resolved, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    std::string result;
+    resolve(pathname, result, ec);
+    if (CP_LIKELY(!ec)) resolved.assign(result, ec);
+  }
+
+  void resolve(const char* pathname, ::cp::path_buffer& resolved)
+  {
+    std::error_code ec;
+    resolve(pathname, resolved, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "path_resolver::resolve pathname: [", pathname, "]");
+    }
+  }
+#endif
+
+  // drops everything cached
+  void invalidate()
+  {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    dropped(nodes_.size());
+    nodes_.clear();
+    open_directories_ = 0;
+  }
+
+  // drops canonical path and everything cached below it
+  void invalidate(std::string_view canonical)
+  {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    drop(canonical, true);
+  }
+
+  statistics stats() const noexcept
+  {
+    statistics result;
+    result.hits    = hits_.load(std::memory_order_relaxed);
+    result.misses  = misses_.load(std::memory_order_relaxed);
+    result.dropped = dropped_.load(std::memory_order_relaxed);
+    return result;
+  }
+
+private:
+  // symbolic links followed by one resolve, as MAXSYMLINKS on linux
+  static constexpr unsigned max_links = 40;
+
+  enum class node_type { directory, symbolic_link, other };
+
+  struct node
+  {
+    node_type             type = node_type::other;
+    std::string           target;   // of symbolic link
+    ::cp::file_descriptor fd;       // O_PATH descriptor of directory, may be closed
+    ::timespec            mtime{};  // of directory when its content was cached, guarded by mutex_
+  };
+
+  void open_root(std::error_code& ec)
+  {
+    CP_ASSERT(options_.max_entries > 0);
+
+    root_ = std::make_shared<node>();
+    root_->type = node_type::directory;
+    root_->fd   = ::cp::open("/", O_PATH | O_DIRECTORY | O_CLOEXEC, ec);
+    if (CP_UNLIKELY(ec)) return;
+    if (options_.revalidate)
+    {
+      ::cp::file_info info;
+      ::cp::fstat(root_->fd, info, ec);
+      root_->mtime = info.last_modification_time();
+    }
+  }
+
+  // pending is absolute
+  void walk(std::string& pending, std::string& resolved, std::error_code& ec)
+  {
+    // directories of resolved, from the root
+    std::vector<std::shared_ptr<node>> directories{ root_ };
+    std::size_t position = 0;
+    unsigned    links    = 0;
+
+    while (position < pending.size())
+    {
+      while (position < pending.size() && '/' == pending[position]) ++position;
+      std::size_t end = position;
+      while (end < pending.size() && '/' != pending[end]) ++end;
+      const std::string_view name(pending.data() + position, end - position);
+      position = end;
+
+      if (name.empty() || "." == name) continue;
+      if (".." == name)
+      {
+        if (directories.size() > 1)
+        {
+          directories.pop_back();
+          resolved.resize(resolved.rfind('/'));
+        }
+        continue;
+      }
+
+      const std::size_t parent_size = resolved.size();
+      resolved.append(1, '/').append(name);
+      if (CP_UNLIKELY(resolved.size() >= PATH_MAX))
+      {
+        ec = std::make_error_code(std::errc::filename_too_long);
+        return;
+      }
+
+      const std::shared_ptr<node> child = lookup(*directories.back(), std::string_view(resolved).substr(0, parent_size), resolved, name.size(), ec);
+      if (CP_UNLIKELY(ec)) return;
+
+      if (node_type::symbolic_link == child->type)
+      {
+        resolved.resize(parent_size);
+        if (CP_UNLIKELY(++links > max_links))
+        {
+          ec = std::make_error_code(std::errc::too_many_symbolic_link_levels);
+          return;
+        }
+        if ('/' == child->target[0])
+        {
+          directories.resize(1);
+          resolved.clear();
+        }
+        pending.replace(0, position, child->target);
+        position = 0;
+      }
+      else if (node_type::directory == child->type)
+      {
+        directories.push_back(child);
+      }
+      else if (position < pending.size())
+      {
+        // anything after a file, even a slash
+        ec = std::make_error_code(std::errc::not_a_directory);
+        return;
+      }
+    }
+
+    if (resolved.empty()) resolved.assign(1, '/');
+  }
+
+  // node of the last name_size bytes of path, child of parent
+  std::shared_ptr<node> lookup(node& parent, std::string_view parent_path, std::string const& path, std::size_t name_size, std::error_code& ec)
+  {
+    if (options_.revalidate)
+    {
+      revalidate(parent, parent_path, ec);
+      if (CP_UNLIKELY(ec)) return nullptr;
+    }
+
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      const auto it = nodes_.find(path);
+      if (it != nodes_.end())
+      {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return it->second;
+      }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+
+    // relative to parent when it is open, by full path otherwise
+    const int   dirfd = parent.fd ? parent.fd.get() : AT_FDCWD;
+    const char* name  = parent.fd ? path.c_str() + path.size() - name_size : path.c_str();
+
+    ::cp::file_info info;
+    if (CP_UNLIKELY(-1 == ::fstatat(dirfd, name, &info, AT_SYMLINK_NOFOLLOW)))
+    {
+      ec = ::cp::make_system_error_code();
+      return nullptr;
+    }
+
+    std::shared_ptr<node> result = std::make_shared<node>();
+    if (info.is_symbolic_link())
+    {
+      result->type = node_type::symbolic_link;
+      read_link(dirfd, name, info.size(), result->target, ec);
+      if (CP_UNLIKELY(ec)) return nullptr;
+    }
+    else if (info.is_directory())
+    {
+      result->type  = node_type::directory;
+      result->mtime = info.last_modification_time();
+      if (open_directories_.load(std::memory_order_relaxed) < options_.max_open_directories)
+      {
+        // O_NOFOLLOW, it must be the directory that was just seen and not a link put in its place
+        result->fd = ::cp::file_descriptor(::openat(dirfd, name, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+        if (CP_UNLIKELY(!result->fd))
+        {
+          ec = ::cp::make_system_error_code();
+          return nullptr;
+        }
+      }
+    }
+
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    if (nodes_.size() >= options_.max_entries)
+    {
+      dropped(nodes_.size());
+      nodes_.clear();
+      open_directories_ = 0;
+    }
+    const auto inserted = nodes_.emplace(path, result);
+    if (!inserted.second) return inserted.first->second;  // other thread was faster
+    if (result->fd) ++open_directories_;
+    return result;
+  }
+
+  // drops cached content of directory when it was modified since it was cached
+  void revalidate(node& directory, std::string_view path, std::error_code& ec)
+  {
+    ::cp::file_info info;
+    const int status = directory.fd ? ::fstat(directory.fd, &info) : ::stat(std::string(path).c_str(), &info);
+    if (CP_UNLIKELY(-1 == status))
+    {
+      ec = ::cp::make_system_error_code();
+      return;
+    }
+
+    const ::timespec mtime = info.last_modification_time();
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      if (mtime.tv_sec == directory.mtime.tv_sec && mtime.tv_nsec == directory.mtime.tv_nsec) return;
+    }
+
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    drop(path.empty() ? std::string_view("/", 1) : path, false);
+    directory.mtime = mtime;
+  }
+
+  // called with the lock held
+  void drop(std::string_view canonical, bool self)
+  {
+    while (canonical.size() > 1 && '/' == canonical.back()) canonical.remove_suffix(1);
+    const bool root = "/" == canonical;
+
+    std::size_t count = 0;
+    for (auto it = nodes_.begin(); it != nodes_.end(); )
+    {
+      std::string const& key = it->first;
+      const bool below = root
+        || (key.size() > canonical.size() && 0 == key.compare(0, canonical.size(), canonical) && '/' == key[canonical.size()])
+        || (self && key == canonical);
+      if (!below)
+      {
+        ++it;
+        continue;
+      }
+      if (it->second->fd) --open_directories_;
+      it = nodes_.erase(it);
+      ++count;
+    }
+    dropped(count);
+  }
+
+  void dropped(std::size_t count) noexcept
+  {
+    dropped_.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  // target of symbolic link, size from lstat is only a hint, the link may change in between
+  static void read_link(int dirfd, const char* name, ::off_t size, std::string& target, std::error_code& ec)
+  {
+    target.resize(size > 0 ? std::size_t(size) + 1 : 64);
+    for (;;)
+    {
+      const ssize_t length = ::readlinkat(dirfd, name, &target[0], target.size());
+      if (CP_UNLIKELY(-1 == length))
+      {
+        ec = ::cp::make_system_error_code();
+        return;
+      }
+      if (std::size_t(length) < target.size())
+      {
+        target.resize(std::size_t(length));
+        break;
+      }
+      target.resize(target.size() * 2);
+    }
+    if (CP_UNLIKELY(target.empty())) ec = std::make_error_code(std::errc::no_such_file_or_directory);
+  }
+
+  options const                                          options_;
+  std::shared_ptr<node>                                  root_;
+  mutable std::shared_mutex                              mutex_;
+  std::unordered_map<std::string, std::shared_ptr<node>> nodes_;              // by canonical path
+  std::atomic<std::size_t>                               open_directories_{ 0 };
+  std::atomic<std::uint64_t>                             hits_{ 0 };
+  std::atomic<std::uint64_t>                             misses_{ 0 };
+  std::atomic<std::uint64_t>                             dropped_{ 0 };
+};
+
+} // namespace cp
+
+#endif
@@ -13,7 +13,9 @@
 #include "concatenate.h"
 #include "util.h"
 
+#include <limits.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include <system_error>
@@ -31,16 +33,23 @@
 #include <pwd.h>
 #include <grp.h>
 
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <ctime>
+#include <memory>
+#include <new>
+#include <string_view>
 
 #ifndef CP_REMOVE_DEPRECATED
 #define CP_REMOVE_DEPRECATED 1
 #endif
 
-
-// TODO( nebojsa ) find the way to fix non nul terminating functions like readlink , readlinkat
-
 namespace cp {
 
 struct file_descriptor_traits 
@@ -59,6 +68,11 @@ inline std::string to_string(::cp::file_descriptor const& fd)
   return fd ? ::cp::to_string(fd.get()): "invalid";
 }
 
+inline std::to_chars_result to_chars(char* first, char* last, ::cp::file_descriptor const& fd) noexcept
+{
+  return fd ? ::cp::to_chars(first, last, fd.get()) : ::cp::to_chars(first, last, "invalid");
+}
+
 CP_DEFINE_SERIALIZATION_SPECIALIZATION(::cp::file_descriptor);
 
 
@@ -87,7 +101,7 @@ open(char const* pathname, int flags)
   ::cp::file_descriptor result = ::cp::open(pathname, flags, ec);
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("error openng file: ", pathname, ", with flags: ", flags));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "error openng file: ", pathname, ", with flags: ", flags);
   }
   return result;
 }
@@ -120,7 +134,7 @@ open(char const*pathname, int flags, ::mode_t mode)
   ::cp::file_descriptor result = ::cp::open(pathname, flags, mode, ec);
   if (CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec,::cp::concat("error opening file: [", pathname, "], flags: [", flags, "], mode [", mode, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "error opening file: [", pathname, "], flags: [", flags, "], mode [", mode, "]");
   }
   return result;
 }
@@ -160,7 +174,7 @@ creat(const char* pathname, ::mode_t mode)
   ::cp::file_descriptor result = cp::creat(pathname, mode, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("error opening file: [", pathname, "], mode: [", mode, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "error opening file: [", pathname, "], mode: [", mode, "]");
   }
   return result;
 }
@@ -187,7 +201,7 @@ read(::cp::file_descriptor const& fd, void* buffer, std::size_t bytes_count)
   const int result =  ::cp::read(fd, buffer, bytes_count, ec);
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("error reading file, fd: [", fd, "], bytes count: [", bytes_count, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "error reading file, fd: [", fd, "], bytes count: [", bytes_count, "]");
   }
   return result;
 }
@@ -214,7 +228,7 @@ write(::cp::file_descriptor const& fd, void* buffer, ::std::size_t bytes_count)
   std::size_t result = cp::write(fd, buffer, bytes_count, ec);
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("error writing to file, fd: [", fd, "] bytes count: [", bytes_count, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "error writing to file, fd: [", fd, "] bytes count: [", bytes_count, "]");
   }
   return result;
 }
@@ -236,9 +250,9 @@ off_t
 lseek(cp::file_descriptor const& fd, ::off_t offset, int whence)
 {
   std::error_code ec;
-  const off_t result = cp::lseek(fd, offset, whence);
+  const off_t result = cp::lseek(fd, offset, whence, ec);
   if ( CP_UNLIKELY(ec )) {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("error seeking into file, fd: [", fd,"] offset: [", (long long) offset, "] whence: [", whence,"]" ));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "error seeking into file, fd: [", fd,"] offset: [", (long long) offset, "] whence: [", whence,"]");
   }
   return result;
 }
@@ -262,7 +276,7 @@ cp::file_descriptor dup(int fd)
   cp::file_descriptor result = cp::dup(fd, ec);
   if (CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("error duplicating fd, fd: [", fd,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "error duplicating fd, fd: [", fd,"]");
   }
   return result;
 }
@@ -306,7 +320,7 @@ ssize_t pread(cp::file_descriptor const& fd, void* buf, size_t nbytes, off_t off
   const ssize_t result = ::cp::pread(fd, buf, nbytes,offset, ec);
   if(CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("pread fd, fd: [", fd,"], nbytes [", nbytes, "], offset: [", offset, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "pread fd, fd: [", fd,"], nbytes [", nbytes, "], offset: [", offset, "]");
   }
   return result;
 }
@@ -331,7 +345,7 @@ CP_FORCE_INLINE
   const ssize_t result = ::cp::pwrite(fd, buf, nbytes, offset , ec);
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("pwrite fd, fd: [", fd,"], nbytes [", nbytes, "], offset: [", offset, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "pwrite fd, fd: [", fd,"], nbytes [", nbytes, "], offset: [", offset, "]");
   }
   return result;
 }
@@ -355,7 +369,7 @@ CP_FORCE_INLINE
   const ssize_t result = ::cp::readv(fd, iov, iovcnt, ec);
   if (CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("readv fd, fd: [", fd,"], iovcnt [", iovcnt, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "readv fd, fd: [", fd,"], iovcnt [", iovcnt, "]");
   }
   return result;
 }
@@ -379,7 +393,7 @@ CP_FORCE_INLINE
   const ::ssize_t result = ::cp::writev(fd, iov, iovcnt, ec);
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("writev fd, fd: [", fd,"], iovcnt [", iovcnt, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "writev fd, fd: [", fd,"], iovcnt [", iovcnt, "]");
   }
   return result;
 }
@@ -405,7 +419,7 @@ CP_FORCE_INLINE
   const ::ssize_t result = ::cp::preadv(fd, iov, iovcnt, offset, ec);
   if (CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("preadv fd, fd: [", fd,"], iovcnt [", iovcnt, "], offset: [", offset, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "preadv fd, fd: [", fd,"], iovcnt [", iovcnt, "], offset: [", offset, "]");
   }
   return result;
 }
@@ -430,7 +444,354 @@ CP_FORCE_INLINE
   const ::size_t result = cp::pwritev(fd, iov, iovcnt, offset,ec);
   if (CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("pwritev fd, fd: [", fd,"], iovcnt [", iovcnt, "], offset: [", offset, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "pwritev fd, fd: [", fd,"], iovcnt [", iovcnt, "], offset: [", offset, "]");
+  }
+  return result;
+}
+#endif
+
+// full transfer helpers, they loop until everything is transferred, retry on EINTR and return
+// number of bytes transferred. error_code overloads return the progress made before the error,
+// read functions return less than requested without error only on end of file
+
+// largest iovcnt accepted by readv and writev, longer arrays are transferred in parts
+#if defined IOV_MAX
+constexpr int max_iovec_count = IOV_MAX;
+#else
+constexpr int max_iovec_count = _XOPEN_IOV_MAX;
+#endif
+
+namespace detail {
+  CP_FORCE_INLINE
+  void advance_iovec(::iovec*& iov, int& iovcnt, std::size_t nbytes) noexcept
+  // consumes nbytes from the front of iovec array, entries are modified in place
+  {
+    while (iovcnt > 0 && nbytes >= iov->iov_len)
+    {
+      nbytes -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt > 0)
+    {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + nbytes;
+      iov->iov_len -= nbytes;
+    }
+    CP_ASSERT(iovcnt > 0 || 0 == nbytes);
+  }
+
+  CP_FORCE_INLINE
+  void skip_empty_iovec(::iovec*& iov, int& iovcnt) noexcept
+  {
+    while (iovcnt > 0 && 0 == iov->iov_len)
+    {
+      ++iov;
+      --iovcnt;
+    }
+  }
+}
+
+CP_FORCE_INLINE std::size_t
+read_exact(::cp::file_descriptor const& fd, void* buffer, std::size_t nbytes, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+
+  std::size_t done = 0;
+  while (done < nbytes)
+  {
+    const ::ssize_t result = ::read(fd, static_cast<char*>(buffer) + done, nbytes - done);
+    if (CP_UNLIKELY(-1 == result))
+    {
+      if (EINTR == errno) continue;
+      ec = ::cp::make_system_error_code();
+      break;
+    }
+    if (0 == result) break;
+    done += result;
+  }
+  return done;
+}
+
+CP_FORCE_INLINE std::size_t
+read_exact(::cp::file_descriptor const& fd, void* buffer, std::size_t nbytes)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::read_exact(fd, buffer, nbytes, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "read_exact fd: [", fd, "], nbytes: [", nbytes, "], transferred: [", result, "]");
+  }
+  return result;
+}
+
+CP_FORCE_INLINE std::size_t
+write_all(::cp::file_descriptor const& fd, const void* buffer, std::size_t nbytes, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+
+  std::size_t done = 0;
+  while (done < nbytes)
+  {
+    const ::ssize_t result = ::write(fd, static_cast<const char*>(buffer) + done, nbytes - done);
+    if (CP_UNLIKELY(-1 == result))
+    {
+      if (EINTR == errno) continue;
+      ec = ::cp::make_system_error_code();
+      break;
+    }
+    done += result;
+  }
+  return done;
+}
+
+CP_FORCE_INLINE std::size_t
+write_all(::cp::file_descriptor const& fd, const void* buffer, std::size_t nbytes)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::write_all(fd, buffer, nbytes, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "write_all fd: [", fd, "], nbytes: [", nbytes, "], transferred: [", result, "]");
+  }
+  return result;
+}
+
+CP_FORCE_INLINE std::size_t
+readv_exact(::cp::file_descriptor const& fd, ::iovec* iov, int iovcnt, std::error_code& ec) noexcept
+// iov entries are advanced in place, after return they describe the part that was not read
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+  CP_ASSERT(iovcnt >= 0);
+
+  std::size_t done = 0;
+  ::cp::detail::skip_empty_iovec(iov, iovcnt);
+  while (iovcnt > 0)
+  {
+    const ::ssize_t result = ::cp::readv(fd, iov, std::min(iovcnt, ::cp::max_iovec_count), ec);
+    if (CP_UNLIKELY(ec))
+    {
+      if (ec != std::errc::interrupted) break;
+      ec.clear();
+      continue;
+    }
+    if (0 == result) break;
+    done += result;
+    ::cp::detail::advance_iovec(iov, iovcnt, result);
+    ::cp::detail::skip_empty_iovec(iov, iovcnt);
+  }
+  return done;
+}
+
+CP_FORCE_INLINE std::size_t
+readv_exact(::cp::file_descriptor const& fd, ::iovec* iov, int iovcnt)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::readv_exact(fd, iov, iovcnt, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "readv_exact fd: [", fd, "], iovcnt: [", iovcnt, "], transferred: [", result, "]");
+  }
+  return result;
+}
+
+CP_FORCE_INLINE std::size_t
+writev_all(::cp::file_descriptor const& fd, ::iovec* iov, int iovcnt, std::error_code& ec) noexcept
+// iov entries are advanced in place, after return they describe the part that was not written
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+  CP_ASSERT(iovcnt >= 0);
+
+  std::size_t done = 0;
+  ::cp::detail::skip_empty_iovec(iov, iovcnt);
+  while (iovcnt > 0)
+  {
+    const ::ssize_t result = ::cp::writev(fd, iov, std::min(iovcnt, ::cp::max_iovec_count), ec);
+    if (CP_UNLIKELY(ec))
+    {
+      if (ec != std::errc::interrupted) break;
+      ec.clear();
+      continue;
+    }
+    done += result;
+    ::cp::detail::advance_iovec(iov, iovcnt, result);
+    ::cp::detail::skip_empty_iovec(iov, iovcnt);
+  }
+  return done;
+}
+
+CP_FORCE_INLINE std::size_t
+writev_all(::cp::file_descriptor const& fd, ::iovec* iov, int iovcnt)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::writev_all(fd, iov, iovcnt, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "writev_all fd: [", fd, "], iovcnt: [", iovcnt, "], transferred: [", result, "]");
+  }
+  return result;
+}
+
+#if (_XOPEN_SOURCE >= 500 ||  _POSIX_C_SOURCE >= 200809L)
+
+CP_FORCE_INLINE std::size_t
+pread_exact(::cp::file_descriptor const& fd, void* buffer, std::size_t nbytes, ::off_t offset, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+  CP_ASSERT(offset >= 0);
+
+  std::size_t done = 0;
+  while (done < nbytes)
+  {
+    const ::ssize_t result = ::pread(fd, static_cast<char*>(buffer) + done, nbytes - done, offset + done);
+    if (CP_UNLIKELY(-1 == result))
+    {
+      if (EINTR == errno) continue;
+      ec = ::cp::make_system_error_code();
+      break;
+    }
+    if (0 == result) break;
+    done += result;
+  }
+  return done;
+}
+
+CP_FORCE_INLINE std::size_t
+pread_exact(::cp::file_descriptor const& fd, void* buffer, std::size_t nbytes, ::off_t offset)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::pread_exact(fd, buffer, nbytes, offset, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "pread_exact fd: [", fd, "], nbytes: [", nbytes, "], offset: [", offset, "], transferred: [", result, "]");
+  }
+  return result;
+}
+
+CP_FORCE_INLINE std::size_t
+pwrite_all(::cp::file_descriptor const& fd, const void* buffer, std::size_t nbytes, ::off_t offset, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+  CP_ASSERT(offset >= 0);
+
+  std::size_t done = 0;
+  while (done < nbytes)
+  {
+    const ::ssize_t result = ::pwrite(fd, static_cast<const char*>(buffer) + done, nbytes - done, offset + done);
+    if (CP_UNLIKELY(-1 == result))
+    {
+      if (EINTR == errno) continue;
+      ec = ::cp::make_system_error_code();
+      break;
+    }
+    done += result;
+  }
+  return done;
+}
+
+CP_FORCE_INLINE std::size_t
+pwrite_all(::cp::file_descriptor const& fd, const void* buffer, std::size_t nbytes, ::off_t offset)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::pwrite_all(fd, buffer, nbytes, offset, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "pwrite_all fd: [", fd, "], nbytes: [", nbytes, "], offset: [", offset, "], transferred: [", result, "]");
+  }
+  return result;
+}
+#endif
+
+#if defined _DEFAULT_SOURCE
+
+CP_FORCE_INLINE std::size_t
+preadv_exact(::cp::file_descriptor const& fd, ::iovec* iov, int iovcnt, ::off_t offset, std::error_code& ec) noexcept
+// iov entries are advanced in place, after return they describe the part that was not read
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+  CP_ASSERT(iovcnt >= 0);
+  CP_ASSERT(offset >= 0);
+
+  std::size_t done = 0;
+  ::cp::detail::skip_empty_iovec(iov, iovcnt);
+  while (iovcnt > 0)
+  {
+    const ::ssize_t result = ::cp::preadv(fd, iov, std::min(iovcnt, ::cp::max_iovec_count), offset + ::off_t(done), ec);
+    if (CP_UNLIKELY(ec))
+    {
+      if (ec != std::errc::interrupted) break;
+      ec.clear();
+      continue;
+    }
+    if (0 == result) break;
+    done += result;
+    ::cp::detail::advance_iovec(iov, iovcnt, result);
+    ::cp::detail::skip_empty_iovec(iov, iovcnt);
+  }
+  return done;
+}
+
+CP_FORCE_INLINE std::size_t
+preadv_exact(::cp::file_descriptor const& fd, ::iovec* iov, int iovcnt, ::off_t offset)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::preadv_exact(fd, iov, iovcnt, offset, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "preadv_exact fd: [", fd, "], iovcnt: [", iovcnt, "], offset: [", offset, "], transferred: [", result, "]");
+  }
+  return result;
+}
+
+CP_FORCE_INLINE std::size_t
+pwritev_all(::cp::file_descriptor const& fd, ::iovec* iov, int iovcnt, ::off_t offset, std::error_code& ec) noexcept
+// iov entries are advanced in place, after return they describe the part that was not written
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+  CP_ASSERT(iovcnt >= 0);
+  CP_ASSERT(offset >= 0);
+
+  std::size_t done = 0;
+  ::cp::detail::skip_empty_iovec(iov, iovcnt);
+  while (iovcnt > 0)
+  {
+    const ::ssize_t result = ::cp::pwritev(fd, iov, std::min(iovcnt, ::cp::max_iovec_count), offset + ::off_t(done), ec);
+    if (CP_UNLIKELY(ec))
+    {
+      if (ec != std::errc::interrupted) break;
+      ec.clear();
+      continue;
+    }
+    done += result;
+    ::cp::detail::advance_iovec(iov, iovcnt, result);
+    ::cp::detail::skip_empty_iovec(iov, iovcnt);
+  }
+  return done;
+}
+
+CP_FORCE_INLINE std::size_t
+pwritev_all(::cp::file_descriptor const& fd, ::iovec* iov, int iovcnt, ::off_t offset)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::pwritev_all(fd, iov, iovcnt, offset, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "pwritev_all fd: [", fd, "], iovcnt: [", iovcnt, "], offset: [", offset, "], transferred: [", result, "]");
   }
   return result;
 }
@@ -456,7 +817,7 @@ void truncate(const char* pathname, ::off_t length)
   ::cp::truncate(pathname, length, ec);
   if(CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("truncate path: [", pathname,"], length: [", length, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "truncate path: [", pathname,"], length: [", length, "]");
   }
 }
 #endif
@@ -481,7 +842,146 @@ void ftruncate(::cp::file_descriptor const& fd, ::off_t length)
   ::cp::ftruncate(fd, length, ec);
   if (CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("ftruncate fd: [", fd,"], length: [", length, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "ftruncate fd: [", fd,"], length: [", length, "]");
+  }
+}
+#endif
+
+#if defined(__linux__) && defined(_GNU_SOURCE)
+CP_FORCE_INLINE
+void fallocate(::cp::file_descriptor const& fd, int mode, ::off_t offset, ::off_t length, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+  CP_ASSERT(offset >= 0);
+  CP_ASSERT(length > 0);
+
+  const int status = ::fallocate(fd, mode, offset, length);
+  if (CP_UNLIKELY( -1 == status)) ec = ::cp::make_system_error_code();
+}
+
+CP_FORCE_INLINE
+void fallocate(::cp::file_descriptor const& fd, int mode, ::off_t offset, ::off_t length)
+{
+  std::error_code ec;
+  ::cp::fallocate(fd, mode, offset, length, ec);
+  if (CP_UNLIKELY( ec ))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "fallocate fd: [", fd,"], mode: [", mode, "], offset: [", offset, "], length: [", length, "]");
+  }
+}
+
+#if defined(FALLOC_FL_PUNCH_HOLE) && defined(FALLOC_FL_KEEP_SIZE)
+// deallocates the range, reading it returns zeros and file size does not change. blocks only
+// partially covered by the range are zeroed instead
+CP_FORCE_INLINE
+void punch_hole(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length, std::error_code& ec) noexcept
+{
+  ::cp::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length, ec);
+}
+
+CP_FORCE_INLINE
+void punch_hole(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length)
+{
+  std::error_code ec;
+  ::cp::punch_hole(fd, offset, length, ec);
+  if (CP_UNLIKELY( ec ))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "punch_hole fd: [", fd,"], offset: [", offset, "], length: [", length, "]");
+  }
+}
+#endif
+
+#if defined(FALLOC_FL_KEEP_SIZE)
+// allocates blocks for the range without changing file size, later writes into it do not
+// allocate. unlike posix_fallocate it fails when file system can not do it
+CP_FORCE_INLINE
+void preallocate(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length, std::error_code& ec) noexcept
+{
+  ::cp::fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, length, ec);
+}
+
+CP_FORCE_INLINE
+void preallocate(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length)
+{
+  std::error_code ec;
+  ::cp::preallocate(fd, offset, length, ec);
+  if (CP_UNLIKELY( ec ))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "preallocate fd: [", fd,"], offset: [", offset, "], length: [", length, "]");
+  }
+}
+#endif
+
+#if defined(FALLOC_FL_ZERO_RANGE)
+// range reads as zeros afterwards, file system may convert it to unwritten extents instead of
+// writing zeros. file grows when range ends past its size
+CP_FORCE_INLINE
+void zero_range(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length, std::error_code& ec) noexcept
+{
+  ::cp::fallocate(fd, FALLOC_FL_ZERO_RANGE, offset, length, ec);
+}
+
+CP_FORCE_INLINE
+void zero_range(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length)
+{
+  std::error_code ec;
+  ::cp::zero_range(fd, offset, length, ec);
+  if (CP_UNLIKELY( ec ))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "zero_range fd: [", fd,"], offset: [", offset, "], length: [", length, "]");
+  }
+}
+#endif
+
+#if defined(FALLOC_FL_COLLAPSE_RANGE)
+// removes the range and moves the rest of the file down, offset and length must be multiples of
+// file system block size
+CP_FORCE_INLINE
+void collapse_range(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length, std::error_code& ec) noexcept
+{
+  ::cp::fallocate(fd, FALLOC_FL_COLLAPSE_RANGE, offset, length, ec);
+}
+
+CP_FORCE_INLINE
+void collapse_range(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length)
+{
+  std::error_code ec;
+  ::cp::collapse_range(fd, offset, length, ec);
+  if (CP_UNLIKELY( ec ))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "collapse_range fd: [", fd,"], offset: [", offset, "], length: [", length, "]");
+  }
+}
+#endif
+#endif
+
+#if (_XOPEN_SOURCE >= 600 || _POSIX_C_SOURCE >= 200112L)
+// guarantees that writes to the range do not fail for lack of space, file grows when range ends
+// past its size. glibc emulates it by writing a byte in every block when file system does not
+// support fallocate
+CP_FORCE_INLINE
+void posix_fallocate(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+  CP_ASSERT(offset >= 0);
+  CP_ASSERT(length > 0);
+
+  const int error_number = ::posix_fallocate(fd, offset, length);
+  if (CP_UNLIKELY(error_number)) ec = ::cp::make_system_error_code(error_number);
+}
+
+CP_FORCE_INLINE
+void posix_fallocate(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length)
+{
+  std::error_code ec;
+  ::cp::posix_fallocate(fd, offset, length, ec);
+  if (CP_UNLIKELY( ec ))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "posix_fallocate fd: [", fd,"], offset: [", offset, "], length: [", length, "]");
   }
 }
 #endif
@@ -502,10 +1002,12 @@ CP_FORCE_INLINE
 ::cp::file_descriptor mkstemp(char* in_template_out_filename)
 {
   std::error_code ec;
+  ::cp::file_descriptor result = ::cp::mkstemp(in_template_out_filename, ec);
   if(CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("mkstemp template [", in_template_out_filename,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "mkstemp template [", in_template_out_filename,"]");
   }
+  return result;
 }
 
 // TODO (nebojsa) what is a best way to provide type safe wrapper for functions with variadic arguments like fcntl
@@ -560,7 +1062,7 @@ void stat(const char* pathname, file_info& fi)
   ::cp::stat(pathname, fi,ec);
   if ( CP_UNLIKELY(ec)) 
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("stat path [",pathname,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "stat path [",pathname,"]");
   }
 }
 
@@ -584,17 +1086,163 @@ void lstat(const char* pathname, ::cp::file_info& statbuf)
   ::cp::lstat(pathname, statbuf,ec);
   if ( CP_UNLIKELY(ec)) 
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("lstat path [",pathname,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "lstat path [",pathname,"]");
+  }
+}
+#endif
+
+#if defined STATX_TYPE
+
+// statx result, only fields requested with the mask and reported back in mask() are valid
+struct extended_file_info : public ::statx
+{
+  unsigned          mask()                    const noexcept { return stx_mask; }
+  bool              has(unsigned fields)      const noexcept { return (stx_mask & fields) == fields; }
+
+  // accessing fields
+  ::dev_t           device()                  const noexcept { return makedev(stx_dev_major, stx_dev_minor);   }
+  std::uint64_t     inode_number()            const noexcept { return stx_ino;     }
+  ::mode_t          mode()                    const noexcept { return stx_mode;    }
+  ::nlink_t         number_of_hard_links()    const noexcept { return stx_nlink;   }
+  ::uid_t           owners_user_id()          const noexcept { return stx_uid;     }
+  ::gid_t           owners_group_id()         const noexcept { return stx_gid;     }
+  ::dev_t           rdevice()                 const noexcept { return makedev(stx_rdev_major, stx_rdev_minor); }
+  std::uint64_t     size()                    const noexcept { return stx_size;    }
+  ::blksize_t       filesystem_block_size()   const noexcept { return stx_blksize; }
+  std::uint64_t     number_of_512B_blocks()   const noexcept { return stx_blocks;  }
+  ::timespec        last_access_time()        const noexcept { return to_timespec(stx_atime); }
+  ::timespec        last_modification_time()  const noexcept { return to_timespec(stx_mtime); }
+  ::timespec        last_status_change()      const noexcept { return to_timespec(stx_ctime); }
+  ::timespec        birth_time()              const noexcept { return to_timespec(stx_btime); }
+  std::uint64_t     attributes()              const noexcept { return stx_attributes; }
+#if defined(STATX_MNT_ID) && defined(_LINUX_STAT_H)
+  std::uint64_t     mount_id()                const noexcept { return stx_mnt_id;  }
+#endif
+#if defined(STATX_DIOALIGN) && defined(_LINUX_STAT_H)
+  // required alignment of O_DIRECT buffers and file offsets, 0 when direct i/o is not supported
+  std::uint32_t     dio_memory_alignment()    const noexcept { return stx_dio_mem_align;    }
+  std::uint32_t     dio_offset_alignment()    const noexcept { return stx_dio_offset_align; }
+#endif
+
+  bool is_block_device()     const noexcept { return (stx_mode & S_IFMT) == S_IFBLK; }
+  bool is_character_device() const noexcept { return (stx_mode & S_IFMT) == S_IFCHR; }
+  bool is_directory()        const noexcept { return (stx_mode & S_IFMT) == S_IFDIR; }
+  bool is_FIFO()             const noexcept { return (stx_mode & S_IFMT) == S_IFIFO; }
+  bool is_socket()           const noexcept { return (stx_mode & S_IFMT) == S_IFSOCK;}
+  bool is_regular_file()     const noexcept { return (stx_mode & S_IFMT) == S_IFREG; }
+  bool is_symbolic_link()    const noexcept { return (stx_mode & S_IFMT) == S_IFLNK; }
+
+private:
+  static ::timespec to_timespec(::statx_timestamp const& t) noexcept
+  {
+    ::timespec result;
+    result.tv_sec  = t.tv_sec;
+    result.tv_nsec = t.tv_nsec;
+    return result;
+  }
+};
+
+static_assert(sizeof(extended_file_info) == sizeof(struct ::statx), "do not add members or virtual funcitons to extended_file_info struct");
+
+// mask is a combination of STATX_* values (STATX_TYPE, STATX_SIZE, STATX_BTIME, ...), fields that
+// are not requested may be skipped by the file system. flags take AT_* values, AT_STATX_DONT_SYNC
+// lets network file systems answer from cache without revalidation
+CP_FORCE_INLINE
+void statx(::cp::file_descriptor const& dirfd, const char* relpath, int flags, unsigned mask, ::cp::extended_file_info& info, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(dirfd);
+  CP_ASSERT(relpath);
+
+  const int status = ::statx(dirfd, relpath, flags, mask, &info);
+  if (CP_UNLIKELY(-1 == status)) ec = ::cp::make_system_error_code();
+}
+
+CP_FORCE_INLINE
+void statx(::cp::file_descriptor const& dirfd, const char* relpath, int flags, unsigned mask, ::cp::extended_file_info& info)
+{
+  std::error_code ec;
+  ::cp::statx(dirfd, relpath, flags, mask, info, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "statx dirfd: [", dirfd, "], file: [", relpath, "], flags: [", flags, "], mask: [", mask, "]");
+  }
+}
+
+CP_FORCE_INLINE
+void statx(const char* pathname, int flags, unsigned mask, ::cp::extended_file_info& info, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(pathname);
+
+  const int status = ::statx(AT_FDCWD, pathname, flags, mask, &info);
+  if (CP_UNLIKELY(-1 == status)) ec = ::cp::make_system_error_code();
+}
+
+CP_FORCE_INLINE
+void statx(const char* pathname, int flags, unsigned mask, ::cp::extended_file_info& info)
+{
+  std::error_code ec;
+  ::cp::statx(pathname, flags, mask, info, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "statx dirfd: [AT_FDCWD], file: [", pathname, "], flags: [", flags, "], mask: [", mask, "]");
+  }
+}
+
+// information about the open file itself, AT_EMPTY_PATH is added to flags
+CP_FORCE_INLINE
+void statx(::cp::file_descriptor const& fd, int flags, unsigned mask, ::cp::extended_file_info& info, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(fd);
+
+  const int status = ::statx(fd, "", flags | AT_EMPTY_PATH, mask, &info);
+  if (CP_UNLIKELY(-1 == status)) ec = ::cp::make_system_error_code();
+}
+
+CP_FORCE_INLINE
+void statx(::cp::file_descriptor const& fd, int flags, unsigned mask, ::cp::extended_file_info& info)
+{
+  std::error_code ec;
+  ::cp::statx(fd, flags, mask, info, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "statx fd: [", fd, "], flags: [", flags, "], mask: [", mask, "]");
   }
 }
+
+#endif
+
+namespace detail {
+  // is_* helpers below need only the file type, with statx nothing else is requested so file
+  // systems that have to revalidate size or timestamps can skip it
+#if defined STATX_TYPE
+  using file_type_info = ::cp::extended_file_info;
+
+  CP_FORCE_INLINE void stat_type(const char* pathname, file_type_info& info) { ::cp::statx(pathname, 0, STATX_TYPE, info); }
+  CP_FORCE_INLINE void stat_type(const char* pathname, file_type_info& info, std::error_code& ec) noexcept { ::cp::statx(pathname, 0, STATX_TYPE, info, ec); }
+  CP_FORCE_INLINE void lstat_type(const char* pathname, file_type_info& info) { ::cp::statx(pathname, AT_SYMLINK_NOFOLLOW, STATX_TYPE, info); }
+  CP_FORCE_INLINE void lstat_type(const char* pathname, file_type_info& info, std::error_code& ec) noexcept { ::cp::statx(pathname, AT_SYMLINK_NOFOLLOW, STATX_TYPE, info, ec); }
+#else
+  using file_type_info = ::cp::file_info;
+
+  CP_FORCE_INLINE void stat_type(const char* pathname, file_type_info& info) { ::cp::stat(pathname, info); }
+  CP_FORCE_INLINE void stat_type(const char* pathname, file_type_info& info, std::error_code& ec) noexcept { ::cp::stat(pathname, info, ec); }
+  CP_FORCE_INLINE void lstat_type(const char* pathname, file_type_info& info) { ::cp::lstat(pathname, info); }
+  CP_FORCE_INLINE void lstat_type(const char* pathname, file_type_info& info, std::error_code& ec) noexcept { ::cp::lstat(pathname, info, ec); }
 #endif
+}
 
 CP_FORCE_INLINE
 bool is_regular_file(const char* pathname )
 // this helper funciton follows symbolic links
 {
-  file_info info;
-  ::cp::stat(pathname, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info);
   return info.is_regular_file();
 }
 
@@ -603,8 +1251,8 @@ bool is_regular_file(const char* pathname, std::error_code& ec) noexcept
 // this helper funciton follows symbolic links
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::stat(pathname, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info, ec);
   return info.is_regular_file();
 }
 
@@ -612,8 +1260,8 @@ CP_FORCE_INLINE
 bool is_directory(const char* pathname)
 // this helper funciton follows symbolic links
 {
-  file_info info;
-  ::cp::stat(pathname, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info);
   return info.is_directory();
 }
 
@@ -622,8 +1270,8 @@ bool is_directory(const char* pathname, std::error_code& ec) noexcept
 // this helper funciton follows symbolic links
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::stat(pathname, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info, ec);
   return info.is_directory();
 }
 
@@ -631,8 +1279,8 @@ CP_FORCE_INLINE
 bool is_socket(const char* pathname)
 // this helper funciton follows symbolic links
 {
-  file_info info;
-  ::cp::stat(pathname, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info);
   return info.is_socket();
 }
 
@@ -641,8 +1289,8 @@ bool is_socket(const char* pathname, std::error_code& ec) noexcept
 // this helper funciton follows symbolic links
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::stat(pathname, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info, ec);
   return info.is_socket();
 }
 
@@ -650,8 +1298,8 @@ CP_FORCE_INLINE
 bool is_FIFO(const char* pathname)
 // this helper funciton follows symbolic links
 {
-  file_info info;
-  ::cp::stat(pathname, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info);
   return info.is_FIFO();
 }
 
@@ -660,8 +1308,8 @@ bool is_FIFO(const char* pathname, std::error_code& ec) noexcept
 // this helper funciton follows symbolic links
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::stat(pathname, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info, ec);
   return info.is_FIFO();
 }
 
@@ -684,8 +1332,8 @@ CP_FORCE_INLINE
 bool is_character_device(const char* pathname)
 // this helper funciton follows symbolic links
 {
-  file_info info;
-  ::cp::stat(pathname, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info);
   return info.is_character_device();
 }
 
@@ -694,8 +1342,8 @@ bool is_character_device(const char* pathname, std::error_code& ec) noexcept
 // this helper funciton follows symbolic links
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::stat(pathname, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info, ec);
   return info.is_character_device();
 }
 
@@ -703,8 +1351,8 @@ CP_FORCE_INLINE
 bool is_block_device(const char* pathname)
 // this helper funciton follows symbolic links
 {
-  file_info info;
-  ::cp::stat(pathname, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info);
   return info.is_block_device();
 }
 
@@ -713,16 +1361,16 @@ bool is_block_device(const char* pathname, std::error_code& ec) noexcept
 // this helper funciton follows symbolic links
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::stat(pathname, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::stat_type(pathname, info, ec);
   return info.is_block_device();
 }
 
 CP_FORCE_INLINE
 bool is_symbolic_link(const char* pathname)
 {
-  file_info info;
-  ::cp::lstat(pathname, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::lstat_type(pathname, info);
   return info.is_symbolic_link();
 }
 
@@ -730,8 +1378,8 @@ CP_FORCE_INLINE
 bool is_symbolic_link(const char* pathname, std::error_code& ec) noexcept 
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::lstat(pathname, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::lstat_type(pathname, info, ec);
   return info.is_symbolic_link();
 }
 
@@ -753,15 +1401,26 @@ void fstat(::cp::file_descriptor const& fd, ::cp::file_info& statbuf)
   ::cp::fstat(fd, statbuf,ec);
   if ( CP_UNLIKELY(ec)) 
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("fstat fd [",fd,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "fstat fd [",fd,"]");
   }
 }
 
+namespace detail {
+  // file type of an open file can not change, so there is nothing to revalidate
+#if defined STATX_TYPE
+  CP_FORCE_INLINE void fstat_type(::cp::file_descriptor const& fd, file_type_info& info) { ::cp::statx(fd, AT_STATX_DONT_SYNC, STATX_TYPE, info); }
+  CP_FORCE_INLINE void fstat_type(::cp::file_descriptor const& fd, file_type_info& info, std::error_code& ec) noexcept { ::cp::statx(fd, AT_STATX_DONT_SYNC, STATX_TYPE, info, ec); }
+#else
+  CP_FORCE_INLINE void fstat_type(::cp::file_descriptor const& fd, file_type_info& info) { ::cp::fstat(fd, info); }
+  CP_FORCE_INLINE void fstat_type(::cp::file_descriptor const& fd, file_type_info& info, std::error_code& ec) noexcept { ::cp::fstat(fd, info, ec); }
+#endif
+}
+
 CP_FORCE_INLINE
 bool is_regular_file(::cp::file_descriptor const& fd)
 {
-  file_info info;
-  ::cp::fstat(fd, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info);
   return info.is_regular_file();
 }
 
@@ -769,16 +1428,16 @@ CP_FORCE_INLINE
 bool is_regular_file(::cp::file_descriptor const& fd, std::error_code& ec) noexcept
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::fstat(fd, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info, ec);
   return info.is_regular_file();
 }
 
 CP_FORCE_INLINE
 bool is_directory(::cp::file_descriptor const& fd)
 {
-  file_info info;
-  ::cp::fstat(fd, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info);
   return info.is_directory();
 }
 
@@ -786,16 +1445,16 @@ CP_FORCE_INLINE
 bool is_directory(::cp::file_descriptor const& fd, std::error_code& ec) noexcept
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::fstat(fd, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info, ec);
   return info.is_directory();
 }
 
 CP_FORCE_INLINE
 bool is_socket(::cp::file_descriptor const& fd)
 {
-  file_info info;
-  ::cp::fstat(fd, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info);
   return info.is_socket();
 }
 
@@ -803,16 +1462,16 @@ CP_FORCE_INLINE
 bool is_socket(::cp::file_descriptor const& fd, std::error_code& ec) noexcept
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::fstat(fd, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info, ec);
   return info.is_socket();
 }
 
 CP_FORCE_INLINE
 bool is_FIFO(::cp::file_descriptor const& fd)
 {
-  file_info info;
-  ::cp::fstat(fd, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info);
   return info.is_FIFO();
 }
 
@@ -820,8 +1479,8 @@ CP_FORCE_INLINE
 bool is_FIFO(::cp::file_descriptor const& fd, std::error_code& ec) noexcept
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::fstat(fd, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info, ec);
   return info.is_FIFO();
 }
 
@@ -841,8 +1500,8 @@ bool is_pipe(::cp::file_descriptor const& fd, std::error_code& ec) noexcept
 CP_FORCE_INLINE
 bool is_character_device(::cp::file_descriptor const& fd)
 {
-  file_info info;
-  ::cp::fstat(fd, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info);
   return info.is_character_device();
 }
 
@@ -850,16 +1509,16 @@ CP_FORCE_INLINE
 bool is_character_device(::cp::file_descriptor const& fd, std::error_code& ec) noexcept
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::fstat(fd, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info, ec);
   return info.is_character_device();
 }
 
 CP_FORCE_INLINE
 bool is_block_device(::cp::file_descriptor const& fd)
 {
-  file_info info;
-  ::cp::fstat(fd, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info);
   return info.is_block_device();
 }
 
@@ -868,8 +1527,8 @@ CP_FORCE_INLINE
 bool is_block_device(::cp::file_descriptor const& fd, std::error_code& ec) noexcept
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::fstat(fd, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info, ec);
   return info.is_block_device();
 }
 
@@ -880,8 +1539,8 @@ bool is_symbolic_link(::cp::file_descriptor const& fd)
 // this helper function only work if file description is obtained with open call 
 // that has O_NOFOLLOW flag or similar
 {
-  file_info info;
-  ::cp::fstat(fd, info);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info);
   return info.is_symbolic_link();
 }
 
@@ -891,8 +1550,8 @@ bool is_symbolic_link(::cp::file_descriptor const& fd, std::error_code& ec) noex
 // that has O_NOFOLLOW flag or similar
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  file_info info;
-  ::cp::fstat(fd, info, ec);
+  ::cp::detail::file_type_info info{};
+  ::cp::detail::fstat_type(fd, info, ec);
   return info.is_symbolic_link();
 }
 #endif
@@ -935,7 +1594,7 @@ void utime(const char* pathname, ::cp::utime_times const& times )
   ::cp::utime(pathname, times);
   if ( ec )
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("utime pathname: [", pathname, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "utime pathname: [", pathname, "]");
   }
 }
 
@@ -947,7 +1606,7 @@ void utime(const char* pathname)
 
   if (CP_UNLIKELY(ec)) 
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("utime pathname: [", pathname, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "utime pathname: [", pathname, "]");
   }
 }
 #endif
@@ -970,7 +1629,7 @@ void utimes(const char* pathname, struct ::timeval tv[2])
   ::cp::utimes(pathname, tv);
   if (ec)
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("utimes pathname: [", pathname, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "utimes pathname: [", pathname, "]");
   }
 }
 
@@ -993,7 +1652,7 @@ void futimes(::cp::file_descriptor const& fd, const timeval tv[2])
   ::cp::futimes(fd, tv, ec);
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("futimes fd [", fd, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "futimes fd [", fd, "]");
   }
 }
 
@@ -1016,7 +1675,7 @@ void lutimes(const char* pathname, struct ::timeval tv[2])
   ::cp::lutimes(pathname, tv);
   if (ec)
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("lutimes pathname: [", pathname, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "lutimes pathname: [", pathname, "]");
   }
 }
 #endif
@@ -1041,7 +1700,7 @@ void utimensat(::cp::file_descriptor const& dirfd, const char* pathname, const :
   ::cp::utimensat(dirfd, pathname, times, flags, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("utimensat dirfd: [", dirfd, "], pathname: [", pathname, "], flags [", flags, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "utimensat dirfd: [", dirfd, "], pathname: [", pathname, "], flags [", flags, "]");
   }
 }
 
@@ -1062,7 +1721,7 @@ void futimens(::cp::file_descriptor const& fd, const ::timespec times[2])
   ::cp::futimens(fd, times, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("futimens fd[", fd, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "futimens fd[", fd, "]");
   }
 }
 #endif
@@ -1085,7 +1744,7 @@ void setvbuf( ::cp::file const& file, char* buf, int mode, std::size_t size)
   ::cp::setvbuf(file, buf, mode, size, ec);
   if ( CP_UNLIKELY(ec)) 
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("setvbuf, mode: [", mode, "] size: [", size, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "setvbuf, mode: [", mode, "] size: [", size, "]");
   }
  }
 
@@ -1107,7 +1766,7 @@ void fsync(::cp::file_descriptor const& fd)
   ::cp::fsync(fd, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("fync fd: [", fd, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "fync fd: [", fd, "]");
   }
 }
 
@@ -1131,7 +1790,7 @@ void fdatasync(::cp::file_descriptor const& fd)
   ::cp::fdatasync(fd, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("fdatasync fd: [", fd, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "fdatasync fd: [", fd, "]");
   }
 }
 #endif
@@ -1156,7 +1815,7 @@ void posix_fadvise(::cp::file_descriptor const& fd, ::off_t offset, ::off_t len,
   ::cp::posix_fadvise(fd, offset, len, advice, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("posix_fadvise fd: [", fd, "], offset: [", offset, "], len: [", len, "], advice: [", advice,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "posix_fadvise fd: [", fd, "], offset: [", offset, "], len: [", len, "], advice: [", advice,"]");
   }
 }
 #endif
@@ -1178,7 +1837,7 @@ void posix_fadvise(::cp::file_descriptor const& fd, ::off_t offset, ::off_t len,
   ::cp::file_descriptor result = ::cp::fileno(stream, ec);
   if ( ec ) 
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("fileno, FILE*: [", stream ,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "fileno, FILE*: [", stream ,"]");
   }
   return result;
 }
@@ -1200,7 +1859,7 @@ void posix_fadvise(::cp::file_descriptor const& fd, ::off_t offset, ::off_t len,
   cp::file result = ::cp::fdopen(fd, mode, ec);
   if ( CP_UNLIKELY(ec)) 
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, cp::concat("fdopen fd", fd, ", mode: [", mode, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "fdopen fd", fd, ", mode: [", mode, "]");
   }
   return result;
 }
@@ -1224,7 +1883,7 @@ void link(const char* oldpath, const char* newpath)
   ::cp::link(oldpath, newpath, ec); 
   if( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("link oldpath: [", oldpath,"], newpath: [", newpath, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "link oldpath: [", oldpath,"], newpath: [", newpath, "]");
   }
 }
 
@@ -1243,10 +1902,10 @@ CP_FORCE_INLINE
 void unlink(const char* pathname)
 {
   std::error_code ec;
-  ::cp::unlink(pathname);
+  ::cp::unlink(pathname, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("unlink pathname: [", pathname,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "unlink pathname: [", pathname,"]");
   }
 }
 
@@ -1269,7 +1928,7 @@ void rename(const char* oldpath, const char* newpath)
   ::cp::rename(oldpath, newpath, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("rename oldpath: [", oldpath,"], newpath: [", newpath, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "rename oldpath: [", oldpath,"], newpath: [", newpath, "]");
   }
 }
 
@@ -1293,7 +1952,7 @@ void symlink(const char* filepath, const char* linkpath)
   ::cp::symlink(filepath, linkpath, ec);
   if ( CP_UNLIKELY(ec)) 
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("symlink filepath: [", filepath,"], newpath: [", linkpath, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "symlink filepath: [", filepath,"], newpath: [", linkpath, "]");
   }
 }
 #endif
@@ -1320,7 +1979,137 @@ ssize_t readlink(const char* pathname, char* buffer, std::size_t bufsz)
   const ssize_t result = ::cp::readlink(pathname, buffer, bufsz, ec);
   if(CP_UNLIKELY( ec ))
   { 
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("readlink pathname: [", pathname, "], buffer ", std::uintptr_t(buffer), "], bufsz: [",bufsz, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "readlink pathname: [", pathname, "], buffer ", std::uintptr_t(buffer), "], bufsz: [",bufsz, "]");
+  }
+  return result;
+}
+#endif
+
+// target of a symbolic link, always nul terminated. short targets are kept inside the object, so
+// reading into a local link_target makes no allocation, longer ones move to the heap
+class link_target
+{
+public:
+  static constexpr std::size_t inline_capacity = 256;
+
+  link_target() noexcept { inline_[0] = '\0'; }
+
+  link_target(link_target const& other)
+  {
+    inline_[0] = '\0';
+    if (other.size_ >= capacity_ && !grow(other.size_ + 1)) throw std::bad_alloc();
+    std::memcpy(data(), other.data(), other.size_ + 1);
+    size_ = other.size_;
+  }
+
+  link_target(link_target&& other) noexcept { take(other); }
+
+  link_target& operator = (link_target const& other)
+  {
+    if (this != &other) *this = link_target(other);
+    return *this;
+  }
+
+  link_target& operator = (link_target&& other) noexcept
+  {
+    if (this != &other) take(other);
+    return *this;
+  }
+
+  // fills the target with read(buffer, size), which returns as readlink(2) does. buffer grows
+  // while the result fills it, since the target may then be truncated
+  template <typename Read>
+  void fill(Read const& read, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    for (;;)
+    {
+      char* buffer = data();
+      const ::ssize_t length = read(buffer, capacity_);
+      if (CP_UNLIKELY(-1 == length))
+      {
+        ec = ::cp::make_system_error_code();
+        break;
+      }
+      if (std::size_t(length) < capacity_)
+      {
+        size_ = std::size_t(length);
+        buffer[size_] = '\0';
+        return;
+      }
+      if (CP_UNLIKELY(!grow(capacity_ * 2)))
+      {
+        ec = std::make_error_code(std::errc::not_enough_memory);
+        break;
+      }
+    }
+    size_ = 0;
+    data()[0] = '\0';
+  }
+
+  const char*      c_str() const noexcept { return data(); }
+  std::string_view view()  const noexcept { return std::string_view(data(), size_); }
+  std::size_t      size()  const noexcept { return size_; }
+  bool             empty() const noexcept { return 0 == size_; }
+
+  operator const char* () const noexcept { return data(); }
+
+private:
+  char*       data()       noexcept { return heap_ ? heap_.get() : inline_; }
+  const char* data() const noexcept { return heap_ ? heap_.get() : inline_; }
+
+  // content is not kept
+  bool grow(std::size_t capacity) noexcept
+  {
+    char* memory = new (std::nothrow) char[capacity];
+    if (CP_UNLIKELY(!memory)) return false;
+    heap_.reset(memory);
+    capacity_ = capacity;
+    return true;
+  }
+
+  void take(link_target& other) noexcept
+  {
+    heap_     = std::move(other.heap_);
+    capacity_ = other.capacity_;
+    size_     = other.size_;
+    if (!heap_) std::memcpy(inline_, other.inline_, size_ + 1);
+
+    other.capacity_  = inline_capacity;
+    other.size_      = 0;
+    other.inline_[0] = '\0';
+  }
+
+  std::unique_ptr<char[]> heap_;
+  std::size_t             size_     = 0;
+  std::size_t             capacity_ = inline_capacity;
+  char                    inline_[inline_capacity];
+};
+
+#if (_XOPEN_SOURCE >= 500 || _POSIX_C_SOURCE >= 200112L || _BSD_SOURCE)
+// whole target, however long it is
+CP_FORCE_INLINE
+::cp::link_target readlink(const char* pathname, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(pathname);
+
+  ::cp::link_target result;
+  result.fill([pathname](char* buffer, std::size_t bufsz) noexcept { return ::readlink(pathname, buffer, bufsz); }, ec);
+  return result;
+}
+
+CP_FORCE_INLINE
+::cp::link_target readlink(const char* pathname)
+{
+  std::error_code ec;
+  ::cp::link_target result = ::cp::readlink(pathname, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "readlink pathname: [", pathname, "]");
   }
   return result;
 }
@@ -1344,7 +2133,7 @@ void mkdir(const char* pathname, ::mode_t mode)
   ::cp::mkdir(pathname, mode, ec);
   if( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("mkdir pathname: [", pathname, "], mode: [", mode, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "mkdir pathname: [", pathname, "], mode: [", mode, "]");
   }
 }
 
@@ -1371,7 +2160,7 @@ char* mkdtemp(char* temp)
 
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("mkdtemp template: [", temp, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "mkdtemp template: [", temp, "]");
   }
   return new_dir;
 }
@@ -1395,7 +2184,7 @@ void rmdir(const char* pathname)
   ::cp::rmdir(pathname, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("rmdir pathname: [", pathname, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "rmdir pathname: [", pathname, "]");
   }
 }
 
@@ -1413,6 +2202,12 @@ std::string to_string(dir_stream const& d)
   return d ? ::cp::to_string(std::uintptr_t(d.get())) : "invalid";
 }
 
+CP_FORCE_INLINE
+std::to_chars_result to_chars(char* first, char* last, dir_stream const& d) noexcept
+{
+  return d ? ::cp::to_chars(first, last, std::uintptr_t(d.get())) : ::cp::to_chars(first, last, "invalid");
+}
+
 CP_DEFINE_SERIALIZATION_SPECIALIZATION(::cp::dir_stream);
 
 CP_FORCE_INLINE
@@ -1434,7 +2229,7 @@ CP_FORCE_INLINE
   ::cp::dir_stream result = ::cp::opendir(dirpath, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("opendir dirpath: [", dirpath, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "opendir dirpath: [", dirpath, "]");
   }
   return result;
 }
@@ -1450,7 +2245,7 @@ CP_FORCE_INLINE
   CP_ASSERT(::cp::is_directory(dir_fd));
 
   ::cp::dir_stream result( ::fdopendir(dir_fd));
-  if (CP_UNLIKELY(result)) ec = ::cp::make_system_error_code();
+  if (CP_UNLIKELY(!result)) ec = ::cp::make_system_error_code();
   return result;
 }
 
@@ -1462,8 +2257,9 @@ CP_FORCE_INLINE
    ::cp::dir_stream result(::cp::fdopendir(dir_fd, ec));
    if ( CP_UNLIKELY(ec))
    {
-     CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("opendir dirpath: [", dir_fd, "]"));
+     CP_THROW_SYSTEM_ERROR_ARGS(ec, "fdopendir dir_fd: [", dir_fd, "]");
    }
+   return result;
 }
 #endif
 
@@ -1490,7 +2286,7 @@ CP_FORCE_INLINE
   ::dirent* const result = ::cp::readdir( dirp, ec);
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("readdir dirpath: [", dirp, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "readdir dirpath: [", dirp, "]");
   }
   return result;
 }
@@ -1524,7 +2320,7 @@ CP_FORCE_INLINE
   ::cp::file_descriptor fd = ::cp::dirfd(dir);
   if ( ec ) 
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("dirfd dir stream: [", dir, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "dirfd dir stream: [", dir, "]");
   }
   return fd;
 }
@@ -1536,6 +2332,61 @@ constexpr std::size_t size_of_dirent( )
   return offsetof(::dirent, d_name) + NAME_MAX + 1;
 }
 
+#if defined(__linux__) && defined(SYS_getdents64)
+
+// layout of the records filled by getdents64, d_name is nul terminated and d_reclen includes
+// padding up to the next record
+struct linux_dirent64
+{
+  std::uint64_t  d_ino;
+  std::int64_t   d_off;
+  unsigned short d_reclen;
+  unsigned char  d_type;
+  char           d_name[1];
+};
+
+namespace detail {
+  CP_FORCE_INLINE
+  std::size_t getdents64(int fd, void* buffer, std::size_t nbytes, std::error_code& ec) noexcept
+  {
+    const long result = ::syscall(SYS_getdents64, fd, buffer, nbytes);
+    if (CP_UNLIKELY(-1 == result))
+    {
+      ec = ::cp::make_system_error_code();
+      return 0;
+    }
+    return std::size_t(result);
+  }
+}
+
+// fills buffer with as many linux_dirent64 records as fit and returns number of bytes filled,
+// 0 at the end of directory. buffer must hold at least one record of size size_of_dirent()
+CP_FORCE_INLINE
+std::size_t getdents64(::cp::file_descriptor const& dir_fd, void* buffer, std::size_t nbytes, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(dir_fd);
+  CP_ASSERT(buffer);
+  CP_ASSERT(nbytes >= ::cp::size_of_dirent());
+
+  return ::cp::detail::getdents64(dir_fd.get(), buffer, nbytes, ec);
+}
+
+CP_FORCE_INLINE
+std::size_t getdents64(::cp::file_descriptor const& dir_fd, void* buffer, std::size_t nbytes)
+{
+  std::error_code ec;
+  const std::size_t result = ::cp::getdents64(dir_fd, buffer, nbytes, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "getdents64 dir_fd: [", dir_fd, "], buffer: [", std::uintptr_t(buffer), "], nbytes: [", nbytes, "]");
+  }
+  return result;
+}
+
+#endif
+
 #if (CP_REMOVE_DEPRECATED == 0)
 
 CP_FORCE_INLINE
@@ -1558,8 +2409,8 @@ void readdir_r(::cp::dir_stream const& dir, ::dirent* entry, dirent** result)
   ::cp::readdir_r(dir, entry, result, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, 
-      ::cp::concat("readdir_r dir stream: [", dir, "], entry: [", std::uintptr_t(entry) ,"], result: [", std::uintptr_t(result), "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, 
+      "readdir_r dir stream: [", dir, "], entry: [", std::uintptr_t(entry) ,"], result: [", std::uintptr_t(result), "]");
   }
 }
 
@@ -1594,9 +2445,11 @@ int nftw(
   )
 {
   std::error_code ec;
-  const int result = ::cp::nftw(pathdir, func, nopenfd, flags);
-
-  if ( CP_UNLIKELY(-1 == result)) ec = ::cp::make_system_error_code();
+  const int result = ::cp::nftw(pathdir, func, nopenfd, flags, ec);
+  if ( CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "nftw pathdir: [", pathdir, "], nopenfd: [", nopenfd, "], flags: [", flags, "]");
+  }
   return result;
 }
 #endif
@@ -1620,7 +2473,7 @@ char *getcwd(char *buf, size_t size)
   char* result = ::cp::getcwd(buf, size, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("getcwd buf: [", std::uintptr_t(buf), "], size: [", size ,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "getcwd buf: [", std::uintptr_t(buf), "], size: [", size ,"]");
   }
   return result;
 }
@@ -1674,7 +2527,7 @@ char *getwd(char *buf)
   char * const result = ::cp::getwd(buf, ec);
   if (CP_UNLIKELY(ec))  
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("getwd buf: [", std::uintptr_t(result), "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "getwd buf: [", std::uintptr_t(result), "]");
   }
   return result;
 }
@@ -1699,7 +2552,7 @@ void chdir(const char* pathname)
   ::cp::chdir(pathname, ec);
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("chdir pathname: [",pathname, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "chdir pathname: [",pathname, "]");
   }
 }
 
@@ -1723,7 +2576,7 @@ void fchdir(::cp::file_descriptor const& fd)
   ::cp::fchdir(fd, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("fchdir fd: [", fd, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "fchdir fd: [", fd, "]");
   }
 }
 #endif
@@ -1756,7 +2609,7 @@ openat(::cp::file_descriptor const& dirfd, char const* relpath, int flags)
   ::cp::file_descriptor result = ::cp::openat(dirfd, relpath, flags, ec);
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("opendat dirfd: [", dirfd, "],  file: [", relpath, "], flags: [", flags,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "opendat dirfd: [", dirfd, "],  file: [", relpath, "], flags: [", flags,"]");
   }
   return result;
 }
@@ -1789,7 +2642,7 @@ openat(::cp::file_descriptor const& dirfd, char const * relpath, int flags, ::mo
   ::cp::file_descriptor result = ::cp::openat(dirfd,relpath, flags, mode, ec);
   if (CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("openat dirfd: [", dirfd, ", file: [", relpath, "], flags: [", flags, "], mode [", mode, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "openat dirfd: [", dirfd, ", file: [", relpath, "], flags: [", flags, "], mode [", mode, "]");
   }
   return result;
 }
@@ -1818,7 +2671,7 @@ openat(char const* relpath, int flags)
   ::cp::file_descriptor result = ::cp::openat( relpath, flags, ec);
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("opendat dirfd: [AT_FDCWD],  file: [", relpath, "], flags: [", flags,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "opendat dirfd: [AT_FDCWD],  file: [", relpath, "], flags: [", flags,"]");
   }
   return result;
 }
@@ -1849,7 +2702,7 @@ openat(char const * relpath, int flags, ::mode_t mode)
   ::cp::file_descriptor result = ::cp::openat(relpath, flags, mode, ec);
   if (CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("openat dirfd: [AT_FDCWD], file: [", relpath, "], flags: [", flags, "], mode [", mode, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "openat dirfd: [AT_FDCWD], file: [", relpath, "], flags: [", flags, "], mode [", mode, "]");
   }
   return result;
 }
@@ -1885,7 +2738,7 @@ void fstatat(::cp::file_descriptor const& dirfd, const char *relpath, ::cp::file
   ::cp::fstatat(dirfd, relpath, file_info, flags, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("fstatat fd: [", dirfd, "], file: [", relpath, "], flags: [", flags, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "fstatat fd: [", dirfd, "], file: [", relpath, "], flags: [", flags, "]");
   }
 }
 
@@ -1907,7 +2760,7 @@ void fstatat( const char *relpath, ::cp::file_info& file_info, int flags)
   ::cp::fstatat( relpath, file_info, flags, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("fstatat fd: [AT_FDCWD], file: [", relpath, "], flags: [", flags, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "fstatat fd: [AT_FDCWD], file: [", relpath, "], flags: [", flags, "]");
   }
 }
 
@@ -1923,7 +2776,7 @@ void linkat(
   noexcept
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  CP_ASSERT(ec);
+  CP_ASSERT(!ec);
 
   const int status = ::linkat( 
     (!!olddir_fd) ? olddir_fd : AT_FDCWD,
@@ -1949,11 +2802,9 @@ void linkat(
 
   if( CP_UNLIKELY(ec))
   {
-   CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat(
+   CP_THROW_SYSTEM_ERROR_ARGS(ec, 
        "linkat : olddir_fd: [", olddir_fd, "], old_replpath: [", old_relpath, 
-       "], newdir_fd: [", newdir_fd, "], new_replpath: [",new_relpath , "], flags: [", flags, "]"
-     )
-   );
+       "], newdir_fd: [", newdir_fd, "], new_replpath: [",new_relpath , "], flags: [", flags, "]");
   }
 }
 
@@ -1977,7 +2828,7 @@ void unlinkat(::cp::file_descriptor const& dirfd, const char* relpath, int flags
   ::cp::unlinkat(dirfd, relpath, flags ,ec);
   if ( CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat( "unlinkat : dirfd: [", dirfd, "], relpath: [", relpath, ", flags: [", flags, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec,  "unlinkat : dirfd: [", dirfd, "], relpath: [", relpath, ", flags: [", flags, "]");
   }
 }
 
@@ -1999,7 +2850,7 @@ void unlinkat(const char* relpath, int flags)
   ::cp::unlinkat(relpath, flags ,ec);
   if ( CP_UNLIKELY( ec ))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat( "unlinkat : dirfd: [AT_FDCWD], relpath: [", relpath, ", flags: [", flags, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec,  "unlinkat : dirfd: [AT_FDCWD], relpath: [", relpath, ", flags: [", flags, "]");
   }
 }
 
@@ -2023,7 +2874,7 @@ void mkdirat(::cp::file_descriptor const& dirfd, const char* relpath , ::mode_t
   ::cp::mkdirat(dirfd, relpath, mode, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("mkdir: dirfd [", dirfd, "], relpath: [", relpath, "], mode: [", mode, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "mkdir: dirfd [", dirfd, "], relpath: [", relpath, "], mode: [", mode, "]");
   }
 }
 
@@ -2045,7 +2896,7 @@ void mkdirat(const char* relpath , ::mode_t mode)
   ::cp::mkdirat(relpath, mode, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("mkdir: dirfd [AT_FDCWD], relpath: [", relpath, "], mode: [", mode, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "mkdir: dirfd [AT_FDCWD], relpath: [", relpath, "], mode: [", mode, "]");
   }
 }
 
@@ -2070,7 +2921,7 @@ void symlinkat(const char *target, ::cp::file_descriptor const& newdirfd, const
   ::cp::symlinkat(target, newdirfd, linkpath, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("symlinkat, targed: [", target, "], dirfd: [", newdirfd, "] linkpath[", linkpath, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "symlinkat, targed: [", target, "], dirfd: [", newdirfd, "] linkpath[", linkpath, "]");
   }
 }
 
@@ -2093,7 +2944,7 @@ void symlinkat(const char *target,  const char *linkpath)
   ::cp::symlinkat(target, linkpath, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("symlinkat, targed: [", target, "], dirfd: [AT_FDCWD] linkpath[", linkpath, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "symlinkat, targed: [", target, "], dirfd: [AT_FDCWD] linkpath[", linkpath, "]");
   }
 }
 
@@ -2108,7 +2959,7 @@ void renameat(
   noexcept
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
-  CP_ASSERT(ec);
+  CP_ASSERT(!ec);
 
   const int status = ::renameat( 
     (!!olddir_fd) ? olddir_fd : AT_FDCWD,
@@ -2133,14 +2984,66 @@ void renameat(
 
   if( CP_UNLIKELY(ec))
   {
-   CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat(
+   CP_THROW_SYSTEM_ERROR_ARGS(ec, 
        "renameat : olddir_fd: [", olddir_fd, "], old_replpath: [", old_relpath, 
-       "], newdir_fd: [", newdir_fd, "], new_replpath: [",new_relpath , "]"
-     )
-   );
+       "], newdir_fd: [", newdir_fd, "], new_replpath: [",new_relpath , "]");
+  }
+}
+
+#if defined(__linux__) && defined(RENAME_NOREPLACE)
+// renameat with flags, RENAME_NOREPLACE fails with EEXIST instead of replacing new_relpath,
+// RENAME_EXCHANGE swaps the two names atomically, RENAME_WHITEOUT leaves a whiteout object for
+// overlay file systems in place of old_relpath. flags not supported by the file system fail with
+// EINVAL
+CP_FORCE_INLINE
+void renameat2(
+  ::cp::file_descriptor const& olddir_fd, // valid dir file descriptor or uninitilazed than dir is current working directory
+  const char* old_relpath,
+  ::cp::file_descriptor const& newdir_fd, // valid dir file descriptor or uninitilazed than dir is current working directory
+  const char* new_relpath,
+  unsigned flags,
+  std::error_code& ec
+)
+  noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(old_relpath);
+  CP_ASSERT(new_relpath);
+
+  const int status = ::renameat2(
+    (!!olddir_fd) ? olddir_fd : AT_FDCWD,
+    old_relpath,
+    (!!newdir_fd) ? newdir_fd : AT_FDCWD,
+    new_relpath,
+    flags
+    );
+
+  if ( CP_UNLIKELY(-1 == status)) ec = ::cp::make_system_error_code();
+}
+
+CP_FORCE_INLINE
+void renameat2(
+  ::cp::file_descriptor const& olddir_fd,
+  const char* old_relpath,
+  ::cp::file_descriptor const& newdir_fd,
+  const char* new_relpath,
+  unsigned flags
+  )
+{
+  std::error_code ec;
+  ::cp::renameat2(olddir_fd, old_relpath, newdir_fd, new_relpath, flags, ec);
+
+  if( CP_UNLIKELY(ec))
+  {
+   CP_THROW_SYSTEM_ERROR_ARGS(ec,
+       "renameat2 : olddir_fd: [", olddir_fd, "], old_replpath: [", old_relpath,
+       "], newdir_fd: [", newdir_fd, "], new_replpath: [",new_relpath , "], flags: [", flags, "]");
   }
 }
+#endif
 
+CP_FORCE_INLINE
 ssize_t readlinkat(::cp::file_descriptor const& dirfd, const char *pathname, char *buf, size_t bufsiz, std::error_code& ec) noexcept
 {
 // NOT SUPPORTED If you find this limiting use readlink
@@ -2161,21 +3064,21 @@ ssize_t readlinkat(::cp::file_descriptor const& dirfd, const char *pathname, cha
   return result;
 }
 
+CP_FORCE_INLINE
 ssize_t readlinkat(::cp::file_descriptor const& dirfd, const char *pathname, char *buf, size_t bufsiz)
 {
   std::error_code ec;
   const ::size_t result = ::cp::readlinkat(dirfd, pathname, buf, bufsiz,ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, 
-      ::cp::concat("readlink dirfd: [", dirfd, "] pathname: [", pathname,
-                   "], buffer: [", std::uintptr_t(buf), ", bufsiz: [", bufsiz, "]"
-      )
-    );
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, 
+      "readlink dirfd: [", dirfd, "] pathname: [", pathname,
+      "], buffer: [", std::uintptr_t(buf), ", bufsiz: [", bufsiz, "]");
   }
   return result;
 }
 
+CP_FORCE_INLINE
 ssize_t readlinkat(const char *pathname, char *buf, size_t bufsiz, std::error_code& ec) noexcept
 {
   static_assert(std::is_lvalue_reference<decltype(ec)>::value);
@@ -2187,17 +3090,42 @@ ssize_t readlinkat(const char *pathname, char *buf, size_t bufsiz, std::error_co
   return result;
 }
 
+CP_FORCE_INLINE
 ssize_t readlinkat( const char *pathname, char *buf, size_t bufsiz)
 {
   std::error_code ec;
   const ::size_t result = ::cp::readlinkat(pathname, buf, bufsiz,ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, 
-      ::cp::concat("readlink dirfd: [AT_FDCWD] pathname: [", pathname,
-                   "], buffer: [", std::uintptr_t(buf), ", bufsiz: [", bufsiz, "]"
-      )
-    );
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, 
+      "readlink dirfd: [AT_FDCWD] pathname: [", pathname,
+      "], buffer: [", std::uintptr_t(buf), ", bufsiz: [", bufsiz, "]");
+  }
+  return result;
+}
+
+// whole target, however long it is
+CP_FORCE_INLINE
+::cp::link_target readlinkat(::cp::file_descriptor const& dirfd, const char* pathname, std::error_code& ec) noexcept
+{
+  static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+  CP_ASSERT(!ec);
+  CP_ASSERT(dirfd);
+  CP_ASSERT(pathname);
+
+  ::cp::link_target result;
+  result.fill([&dirfd, pathname](char* buffer, std::size_t bufsiz) noexcept { return ::readlinkat(dirfd, pathname, buffer, bufsiz); }, ec);
+  return result;
+}
+
+CP_FORCE_INLINE
+::cp::link_target readlinkat(::cp::file_descriptor const& dirfd, const char* pathname)
+{
+  std::error_code ec;
+  ::cp::link_target result = ::cp::readlinkat(dirfd, pathname, ec);
+  if (CP_UNLIKELY(ec))
+  {
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "readlinkat dirfd: [", dirfd, "], pathname: [", pathname, "]");
   }
   return result;
 }
@@ -2225,7 +3153,7 @@ void chroot(const char* pathname)
   ::cp::chroot(pathname,ec);
   if( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("chroot pathame: [", pathname, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "chroot pathame: [", pathname, "]");
   }
 }
 #endif
@@ -2239,7 +3167,7 @@ char* realpath(const char* pathname, char* resolved_path, std::error_code& ec) n
   CP_ASSERT(resolved_path); // check relpath(const char* );
 
   char * const  result = ::realpath(pathname, resolved_path);
-  if(CP_UNLIKELY(!result)) ec == ::cp::make_system_error_code();
+  if(CP_UNLIKELY(!result)) ec = ::cp::make_system_error_code();
   return result;
 }
 
@@ -2250,7 +3178,7 @@ char* realpath(const char* pathname, char* resolved_path)
   char * const result = ::cp::realpath(pathname, resolved_path, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("realpath, pathname: [", pathname, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "realpath, pathname: [", pathname, "]");
   }
   return result;
 }
@@ -2264,7 +3192,7 @@ CP_FORCE_INLINE
   CP_ASSERT(pathname);
 
   char * const  result = ::realpath(pathname, nullptr);
-  if(CP_UNLIKELY(!result)) ec == ::cp::make_system_error_code();
+  if(CP_UNLIKELY(!result)) ec = ::cp::make_system_error_code();
   return ::cp::unique_malloc_ptr<char[]>(result);
 }
 
@@ -2276,7 +3204,7 @@ CP_FORCE_INLINE
   ::cp::unique_malloc_ptr<char[]> result = ::cp::realpath(pathname, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("realpath, pathname: [", pathname, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "realpath, pathname: [", pathname, "]");
   }
   return result;
 }
@@ -2300,7 +3228,7 @@ char *dirname(char *pathname)
   char * const result = ::cp::dirname(pathname, ec);
   if ( CP_UNLIKELY(ec)) 
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("dirname pathname: [", pathname, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "dirname pathname: [", pathname, "]");
   }
   return result;
 }
@@ -2324,7 +3252,7 @@ char *basename(char *pathname)
   char * const result = ::cp::basename(pathname, ec);
   if ( CP_UNLIKELY(ec)) 
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("basename pathname: [", pathname, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "basename pathname: [", pathname, "]");
   }
   return result;
 }
@@ -2351,7 +3279,7 @@ struct ::passwd *getpwnam(const char *name)
   ::passwd* const result = ::cp::getpwnam(name, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("getpwnam name: [", name, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "getpwnam name: [", name, "]");
   }
   return result;
 }
@@ -2378,7 +3306,7 @@ CP_FORCE_INLINE
   ::passwd* const result = ::cp::getpwuid(uid);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("getpwuid uid: [", uid, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "getpwuid uid: [", uid, "]");
   }
   return result;
 }
@@ -2403,7 +3331,7 @@ struct ::group *getgrnam(const char *name)
   ::group * const result = ::cp::getgrnam(name, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("getgrnam name: [", name, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "getgrnam name: [", name, "]");
   }
   return result;
 }
@@ -2430,7 +3358,7 @@ struct ::group *getgrgid(::gid_t gid)
   ::group* const result = ::cp::getgrgid(gid);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("getgrgid uid: [", gid, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "getgrgid uid: [", gid, "]");
   }
   return result;
 }
@@ -2438,16 +3366,18 @@ struct ::group *getgrgid(::gid_t gid)
 #if (_POSIX_C_SOURCE >= 1 || _XOPEN_SOURCE || _BSD_SOURCE || _SVID_SOURCE || _POSIX_SOURCE )
 
 namespace detail {
+  // sysconf is asked only once, -1 means that system does not suggest the size
   CP_FORCE_INLINE
-  bool check_getpwnam_r_buffer_size(std::size_t nbytes)
+  long getpw_r_size_max() noexcept
   {
-    errno = 0; 
-    const int min_bytes = sysconf(_SC_GETPW_R_SIZE_MAX);
-    const int error_number = errno;
-    if ( (-1 == min_bytes) && (error_number != 0))
-    {
-      CP_THROW_SYSTEM_ERROR_MSG(::cp::make_system_error_code(error_number), ::cp::concat("check_getpwnam_r_buffer_size unable to check bounds error"));
-    }
+    static const long size = ::sysconf(_SC_GETPW_R_SIZE_MAX);
+    return size;
+  }
+
+  CP_FORCE_INLINE
+  bool check_getpwnam_r_buffer_size(std::size_t nbytes) noexcept
+  {
+    const long min_bytes = ::cp::detail::getpw_r_size_max();
     return (-1 == min_bytes) ? true : ((std::size_t)min_bytes <= nbytes);
   }
 }
@@ -2483,9 +3413,8 @@ bool getpwnam_r(const char *name, struct ::passwd *pwd, char *buf, size_t buflen
   const bool found = ::cp::getpwnam_r(name, pwd, buf, buflen,ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, 
-      ::cp::concat("getpwan_r name: [", name, "] pwd: [", std::uintptr_t(pwd), "], buf: [", std::uintptr_t(buf), "], buflen: [", buflen,"]")
-      );
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, 
+      "getpwan_r name: [", name, "] pwd: [", std::uintptr_t(pwd), "], buf: [", std::uintptr_t(buf), "], buflen: [", buflen,"]");
   }
   return found;
 }
@@ -2521,24 +3450,25 @@ bool getpwuid_r(::uid_t uid, struct ::passwd *pwd, char *buf, std::size_t buflen
   const bool found = ::cp::getpwuid_r(uid, pwd, buf, buflen, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, 
-      ::cp::concat("getpwuid_r uid: [", uid, "] pwd: [", std::uintptr_t(pwd), "], buf: [", std::uintptr_t(buf), "], buflen: [", buflen,"]")
-      );
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, 
+      "getpwuid_r uid: [", uid, "] pwd: [", std::uintptr_t(pwd), "], buf: [", std::uintptr_t(buf), "], buflen: [", buflen,"]");
   }
   return found;
 }
 
 namespace detail {
+  // sysconf is asked only once, -1 means that system does not suggest the size
   CP_FORCE_INLINE
-  bool check_getgrnam_r_buffer_size(std::size_t nbytes)
+  long getgr_r_size_max() noexcept
   {
-    errno = 0; 
-    const int min_bytes = sysconf(_SC_GETGR_R_SIZE_MAX);
-    const int error_number = errno;
-    if ( (-1 == min_bytes) && (error_number != 0))
-    {
-      CP_THROW_SYSTEM_ERROR_MSG(::cp::make_system_error_code(error_number), ::cp::concat("check_getgrnam_r_buffer_size unable to check bounds error"));
-    }
+    static const long size = ::sysconf(_SC_GETGR_R_SIZE_MAX);
+    return size;
+  }
+
+  CP_FORCE_INLINE
+  bool check_getgrnam_r_buffer_size(std::size_t nbytes) noexcept
+  {
+    const long min_bytes = ::cp::detail::getgr_r_size_max();
     return (-1 == min_bytes) ? true : ((std::size_t)min_bytes <= nbytes);
   }
 }
@@ -2575,9 +3505,8 @@ bool getgrnam_r(const char *name, struct ::group *grp, char *buf, size_t buflen)
   const bool found = ::cp::getgrnam_r(name, grp, buf, buflen,ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, 
-      ::cp::concat("getgrnam_r name: [", name, "] grp: [", std::uintptr_t(grp), "], buf: [", std::uintptr_t(buf), "], buflen: [", buflen,"]")
-      );
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, 
+      "getgrnam_r name: [", name, "] grp: [", std::uintptr_t(grp), "], buf: [", std::uintptr_t(buf), "], buflen: [", buflen,"]");
   }
   return found;
 }
@@ -2613,9 +3542,8 @@ bool getgrgid_r(::gid_t gid, struct ::group *grp, char *buf, std::size_t buflen)
   const bool found = ::cp::getgrgid_r(gid, grp, buf, buflen, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, 
-      ::cp::concat("getgrgid_r gid: [", gid, "] grp: [", std::uintptr_t(grp), "], buf: [", std::uintptr_t(buf), "], buflen: [", buflen,"]")
-      );
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, 
+      "getgrgid_r gid: [", gid, "] grp: [", std::uintptr_t(grp), "], buf: [", std::uintptr_t(buf), "], buflen: [", buflen,"]");
   }
   return found;
 }
@@ -2630,6 +3558,7 @@ struct pswd_environment
     static_assert(std::is_lvalue_reference<decltype(ec)>::value);
     CP_ASSERT(!ec);
 
+    errno = 0;
     struct ::passwd* result = ::getpwent();
     if (CP_UNLIKELY(nullptr == result && errno)) ec = ::cp::make_system_error_code();
     return result;
@@ -2641,13 +3570,40 @@ struct pswd_environment
     struct ::passwd* result = getpwent(ec);
     if ( CP_UNLIKELY(ec))
     {
-      CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("pswd_environment::getpwent"));
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "pswd_environment::getpwent");
     }
     return result;
   }
  ~pswd_environment() { ::endpwent(); }
 };
 
+struct grp_environment
+{
+  grp_environment() noexcept { ::setgrent(); }
+  struct ::group* getgrent( std::error_code& ec) noexcept 
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    errno = 0;
+    struct ::group* result = ::getgrent();
+    if (CP_UNLIKELY(nullptr == result && errno)) ec = ::cp::make_system_error_code();
+    return result;
+  }
+
+  struct ::group* getgrent( ) {
+    std::error_code ec;
+
+    struct ::group* result = getgrent(ec);
+    if ( CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "grp_environment::getgrent");
+    }
+    return result;
+  }
+ ~grp_environment() { ::endgrent(); }
+};
+
 CP_FORCE_INLINE ::uid_t getuid()  noexcept { return ::getuid();  }
 CP_FORCE_INLINE ::uid_t geteuid() noexcept { return ::geteuid(); }
 CP_FORCE_INLINE ::gid_t getgid()  noexcept { return ::getgid();  }
@@ -2670,7 +3626,7 @@ void setuid(::uid_t uid)
   ::cp::setuid(uid, ec); 
   if (CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("setuid [", uid,"]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "setuid [", uid,"]");
   }
 }
 
@@ -2692,7 +3648,7 @@ void setgid(::gid_t gid)
   ::cp::setgid(gid, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("setgid [", gid, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "setgid [", gid, "]");
   }
 }
 
@@ -2713,7 +3669,7 @@ void seteuid(::uid_t uid)
   ::cp::seteuid(uid, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("seteuid [", uid, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "seteuid [", uid, "]");
   }
 }
 
@@ -2734,7 +3690,7 @@ void setegid(::gid_t gid)
   ::cp::setegid(gid, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("setegid gid[", gid, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "setegid gid[", gid, "]");
   }
 }
 
@@ -2756,7 +3712,7 @@ void setresuid( ::uid_t ruid, ::uid_t euid, ::uid_t suid)
   ::cp::setresuid(ruid, euid, suid, ec); 
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("setresuid gid: [", ruid, "], euid: [",euid, "], suid: [", suid, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "setresuid gid: [", ruid, "], euid: [",euid, "], suid: [", suid, "]");
   }
 }
 
@@ -2778,7 +3734,7 @@ void setresgid(::gid_t rgid, ::gid_t egid, ::gid_t sgid)
   ::cp::setresgid(rgid, egid, sgid, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("setresgid rgid: [",rgid,"], egid: [", egid, "], sgid: [", sgid, "]"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "setresgid rgid: [",rgid,"], egid: [", egid, "], sgid: [", sgid, "]");
   }
 }
 
@@ -2801,7 +3757,7 @@ void gettimeofday( struct ::timeval& tv)
   cp::gettimeofday(tv, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("gettimeofday"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "gettimeofday");
   }
 }
 
@@ -2824,7 +3780,7 @@ void settimeofday(struct ::timeval& tv)
   cp::settimeofday(tv, ec);
   if ( CP_UNLIKELY(ec))
   {
-    CP_THROW_SYSTEM_ERROR_MSG(ec, ::cp::concat("settimeofday"));
+    CP_THROW_SYSTEM_ERROR_ARGS(ec, "settimeofday");
   }
 }
 
@@ -0,0 +1,192 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#if (_POSIX_C_SOURCE >= 200112L)
+
+namespace cp {
+
+// page cache policy for reading a file once from start to end. pages are requested window bytes
+// ahead of the read position, so they are read before they are needed, and pages more than
+// keep_behind bytes behind it are dropped, so a large file does not push everything else out of
+// the cache. the stream is told about the read position with advance, or reads through read.
+// fd is not owned and must outlive the stream, nothing is locked
+class sequential_stream
+{
+public:
+  struct options
+  {
+    // bytes kept requested ahead of the read position, new request is made when less than
+    // half of it is left
+    ::off_t window      = 8 * 1024 * 1024;
+
+    // consumed bytes left in the cache behind the read position, the rest is dropped with
+    // POSIX_FADV_DONTNEED in steps of at least window / 2. negative keeps everything
+    ::off_t keep_behind = 0;
+
+#if defined(__linux__) && defined(_GNU_SOURCE)
+    // readahead(2) instead of POSIX_FADV_WILLNEED, it is not limited by the device read ahead
+    // size. falls back to fadvise when fd does not support it
+    bool    use_readahead = true;
+#endif
+  };
+
+  struct statistics
+  {
+    std::uint64_t prefetched     = 0;  // bytes requested ahead
+    std::uint64_t dropped        = 0;  // bytes dropped behind
+    std::uint64_t prefetch_calls = 0;
+    std::uint64_t drop_calls     = 0;
+  };
+
+  // reading starts at position, POSIX_FADV_SEQUENTIAL is set for the whole file and the first
+  // window is requested
+  sequential_stream(::cp::file_descriptor const& fd, ::off_t position, options const& opts, std::error_code& ec)
+    : fd_(&fd), options_(opts), position_(position), prefetched_(position), dropped_(position)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    start(ec);
+  }
+
+  sequential_stream(::cp::file_descriptor const& fd, ::off_t position, options const& opts)
+    : fd_(&fd), options_(opts), position_(position), prefetched_(position), dropped_(position)
+  {
+    std::error_code ec;
+    start(ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "sequential_stream fd: [", fd, "], position: [", position, "]");
+    }
+  }
+
+  explicit sequential_stream(::cp::file_descriptor const& fd, ::off_t position = 0) : sequential_stream(fd, position, options()) { }
+
+  // everything before position is consumed
+  void advance(::off_t position, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(position >= position_);
+
+    position_ = position;
+    if (prefetched_ - position_ < options_.window / 2)
+    {
+      prefetch(std::max(prefetched_, position_), position_ + options_.window, ec);
+      if (CP_UNLIKELY(ec)) return;
+    }
+
+    if (options_.keep_behind >= 0)
+    {
+      // the kernel drops only whole pages, a page that is partly in the range would stay cached
+      // and never be dropped by the next call either
+      const ::off_t drop_to = (position_ - options_.keep_behind) / page_size_ * page_size_;
+      if (drop_to - dropped_ >= std::max<::off_t>(options_.window / 2, 1))
+      {
+        ::cp::posix_fadvise(*fd_, dropped_, drop_to - dropped_, POSIX_FADV_DONTNEED, ec);
+        if (CP_UNLIKELY(ec)) return;
+        statistics_.dropped += std::uint64_t(drop_to - dropped_);
+        ++statistics_.drop_calls;
+        dropped_ = drop_to;
+      }
+    }
+  }
+
+  void advance(::off_t position)
+  {
+    std::error_code ec;
+    advance(position, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "sequential_stream::advance fd: [", *fd_, "], position: [", position, "]");
+    }
+  }
+
+  // pread at the read position followed by advance, returns less than nbytes only at end of
+  // file or on error
+  std::size_t read(void* buffer, std::size_t nbytes, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+
+    const std::size_t result = ::cp::pread_exact(*fd_, buffer, nbytes, position_, ec);
+    if (CP_UNLIKELY(ec)) return result;
+    advance(position_ + ::off_t(result), ec);
+    return result;
+  }
+
+  std::size_t read(void* buffer, std::size_t nbytes)
+  {
+    std::error_code ec;
+    const std::size_t result = read(buffer, nbytes, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "sequential_stream::read fd: [", *fd_, "], nbytes: [", nbytes, "], position: [", position_, "]");
+    }
+    return result;
+  }
+
+  ::off_t           position() const noexcept { return position_;   }
+  statistics const& stats()    const noexcept { return statistics_; }
+
+private:
+  void start(std::error_code& ec) noexcept
+  {
+    CP_ASSERT(*fd_);
+    CP_ASSERT(position_ >= 0);
+    CP_ASSERT(options_.window > 0);
+
+    const long page_size = ::sysconf(_SC_PAGESIZE);
+    page_size_ = page_size > 0 ? ::off_t(page_size) : 4096;
+    dropped_   = dropped_ / page_size_ * page_size_;
+
+    ::cp::posix_fadvise(*fd_, 0, 0, POSIX_FADV_SEQUENTIAL, ec);
+    if (CP_LIKELY(!ec)) prefetch(position_, position_ + options_.window, ec);
+  }
+
+  void prefetch(::off_t from, ::off_t to, std::error_code& ec) noexcept
+  {
+#if defined(__linux__) && defined(_GNU_SOURCE)
+    if (options_.use_readahead)
+    {
+      if (0 == ::readahead(*fd_, from, std::size_t(to - from))) return prefetched(from, to);
+      if (EINVAL != errno)
+      {
+        ec = ::cp::make_system_error_code();
+        return;
+      }
+      options_.use_readahead = false;
+    }
+#endif
+    ::cp::posix_fadvise(*fd_, from, to - from, POSIX_FADV_WILLNEED, ec);
+    if (CP_LIKELY(!ec)) prefetched(from, to);
+  }
+
+  void prefetched(::off_t from, ::off_t to) noexcept
+  {
+    statistics_.prefetched += std::uint64_t(to - from);
+    ++statistics_.prefetch_calls;
+    prefetched_ = to;
+  }
+
+  ::cp::file_descriptor const* fd_;
+  options                      options_;
+  ::off_t                      position_;
+  ::off_t                      prefetched_;   // requested up to
+  ::off_t                      dropped_;      // dropped up to, multiple of page_size_
+  ::off_t                      page_size_ = 4096;
+  statistics                   statistics_;
+};
+
+} // namespace cp
+
+#endif
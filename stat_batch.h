@@ -0,0 +1,183 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace cp {
+
+namespace detail {
+  // entries stated by one thread before it takes the next chunk, batches smaller than this are
+  // done on the calling thread
+  constexpr std::size_t stat_batch_chunk = 512;
+
+  // calls stat_one(i, ec) for every index, chunks are taken from a shared counter by the calling
+  // thread and by helpers that run on the pool or on threads started here
+  template <typename StatOne>
+  std::size_t run_stat_batch(std::size_t count, std::error_code* errors, StatOne const& stat_one, ::cp::thread_pool* pool)
+  {
+    const std::size_t chunks = (count + stat_batch_chunk - 1) / stat_batch_chunk;
+    std::atomic<std::size_t> next{ 0 };
+
+    auto work = [&]() noexcept {
+      for (std::size_t chunk = next++; chunk < chunks; chunk = next++)
+      {
+        const std::size_t last = std::min(count, (chunk + 1) * stat_batch_chunk);
+        for (std::size_t i = chunk * stat_batch_chunk; i < last; ++i)
+        {
+          errors[i].clear();
+          stat_one(i, errors[i]);
+        }
+      }
+    };
+
+    const unsigned threads = unsigned(std::min<std::size_t>(chunks, pool ? pool->size() + 1 : ::cp::thread_pool::default_size()));
+    if (threads <= 1)
+    {
+      work();
+    }
+    else if (pool)
+    {
+      // helpers that have not started when the calling thread is done never touch the batch, so it
+      // waits only for started ones. the call can then be made from a task of the same pool, even
+      // when no other worker is free
+      struct helpers
+      {
+        std::mutex              mutex;
+        std::condition_variable done;
+        unsigned                running  = 0;
+        bool                    finished = false;
+      };
+      const std::shared_ptr<helpers> state = std::make_shared<helpers>();
+
+      for (unsigned i = 1; i < threads; ++i)
+      {
+        pool->post([state, &work] {
+          {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->finished) return;
+            ++state->running;
+          }
+          work();
+          std::lock_guard<std::mutex> lock(state->mutex);
+          if (0 == --state->running) state->done.notify_one();
+        });
+      }
+      work();
+
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->finished = true;
+      state->done.wait(lock, [&state] { return 0 == state->running; });
+    }
+    else
+    {
+      std::vector<std::thread> helpers;
+      try
+      {
+        helpers.reserve(threads - 1);
+        for (unsigned i = 1; i < threads; ++i) helpers.emplace_back(work);
+      }
+      catch (std::system_error const&)
+      {
+        // the calling thread takes the chunks helpers would have taken
+      }
+      work();
+      for (std::thread& t : helpers) t.join();
+    }
+
+    return std::size_t(std::count_if(errors, errors + count, [](std::error_code const& ec) { return bool(ec); }));
+  }
+}
+
+// fstatat for every name relative to dirfd, results[i] and errors[i] belong to names[i]. path
+// resolution starts from the already open directory, and large batches are split into chunks
+// stated on several threads. returns number of entries that failed
+inline
+std::size_t fstatat_batch(::cp::file_descriptor const& dirfd, const char* const* names, std::size_t count, int flags, ::cp::file_info* results, std::error_code* errors, ::cp::thread_pool* pool = nullptr)
+{
+  CP_ASSERT(dirfd);
+  CP_ASSERT(names || 0 == count);
+  CP_ASSERT(results || 0 == count);
+  CP_ASSERT(errors || 0 == count);
+
+  return ::cp::detail::run_stat_batch(count, errors, [&](std::size_t i, std::error_code& ec) noexcept {
+    CP_ASSERT(names[i]);
+    ::cp::fstatat(dirfd, names[i], results[i], flags, ec);
+  }, pool);
+}
+
+inline
+std::size_t fstatat_batch(::cp::file_descriptor const& dirfd, std::vector<const char*> const& names, int flags, std::vector<::cp::file_info>& results, std::vector<std::error_code>& errors, ::cp::thread_pool* pool = nullptr)
+{
+  results.resize(names.size());
+  errors.resize(names.size());
+  return ::cp::fstatat_batch(dirfd, names.data(), names.size(), flags, results.data(), errors.data(), pool);
+}
+
+// readlinkat for every name relative to dirfd, results[i] and errors[i] belong to names[i].
+// targets that fit link_target::inline_capacity are read without allocation. returns number of
+// entries that failed
+inline
+std::size_t readlinkat_batch(::cp::file_descriptor const& dirfd, const char* const* names, std::size_t count, ::cp::link_target* results, std::error_code* errors, ::cp::thread_pool* pool = nullptr)
+{
+  CP_ASSERT(dirfd);
+  CP_ASSERT(names || 0 == count);
+  CP_ASSERT(results || 0 == count);
+  CP_ASSERT(errors || 0 == count);
+
+  return ::cp::detail::run_stat_batch(count, errors, [&](std::size_t i, std::error_code& ec) noexcept {
+    CP_ASSERT(names[i]);
+    results[i] = ::cp::readlinkat(dirfd, names[i], ec);
+  }, pool);
+}
+
+inline
+std::size_t readlinkat_batch(::cp::file_descriptor const& dirfd, std::vector<const char*> const& names, std::vector<::cp::link_target>& results, std::vector<std::error_code>& errors, ::cp::thread_pool* pool = nullptr)
+{
+  results.resize(names.size());
+  errors.resize(names.size());
+  return ::cp::readlinkat_batch(dirfd, names.data(), names.size(), results.data(), errors.data(), pool);
+}
+
+#if defined STATX_TYPE
+
+// same as fstatat_batch, but only fields in mask are requested
+inline
+std::size_t statx_batch(::cp::file_descriptor const& dirfd, const char* const* names, std::size_t count, int flags, unsigned mask, ::cp::extended_file_info* results, std::error_code* errors, ::cp::thread_pool* pool = nullptr)
+{
+  CP_ASSERT(dirfd);
+  CP_ASSERT(names || 0 == count);
+  CP_ASSERT(results || 0 == count);
+  CP_ASSERT(errors || 0 == count);
+
+  return ::cp::detail::run_stat_batch(count, errors, [&](std::size_t i, std::error_code& ec) noexcept {
+    CP_ASSERT(names[i]);
+    ::cp::statx(dirfd, names[i], flags, mask, results[i], ec);
+  }, pool);
+}
+
+inline
+std::size_t statx_batch(::cp::file_descriptor const& dirfd, std::vector<const char*> const& names, int flags, unsigned mask, std::vector<::cp::extended_file_info>& results, std::vector<std::error_code>& errors, ::cp::thread_pool* pool = nullptr)
+{
+  results.resize(names.size());
+  errors.resize(names.size());
+  return ::cp::statx_batch(dirfd, names.data(), names.size(), flags, mask, results.data(), errors.data(), pool);
+}
+
+#endif
+
+} // namespace cp
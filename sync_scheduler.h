@@ -0,0 +1,211 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace cp {
+
+// groups durability requests of many threads into one fdatasync (or fsync) per file. a request
+// returns once a sync that started after the request was made has finished, requests that
+// arrive while a sync is running wait and are served together by the next one. the first
+// waiting thread makes the call for the whole batch, there are no background threads
+class sync_scheduler
+{
+  sync_scheduler(sync_scheduler const&) = delete;
+  sync_scheduler& operator = (sync_scheduler const&) = delete;
+
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct options
+  {
+    // fdatasync when true, fsync otherwise
+    bool            data_only = true;
+
+    // batch is synced at once when it has max_batch requests, with fewer of them the syncing
+    // thread waits up to max_delay for more. max_delay 0 never waits, latency is then one sync
+    // in the worst case and batching comes only from requests made during a running sync
+    std::size_t     max_batch = 64;
+    clock::duration max_delay = clock::duration::zero();
+
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+    // ranges given with requests are submitted for write back with sync_file_range before the
+    // final sync, so the device gets them together
+    bool            write_ranges_first = false;
+#endif
+  };
+
+  struct statistics
+  {
+    std::uint64_t requests = 0;   // served requests
+    std::uint64_t syncs    = 0;   // fdatasync or fsync calls made
+
+    std::uint64_t saved() const noexcept { return requests - syncs; }
+  };
+
+  sync_scheduler() : sync_scheduler(options()) { }
+
+  explicit sync_scheduler(options const& opts)
+    : options_(opts)
+  {
+    CP_ASSERT(opts.max_batch > 0);
+  }
+
+  // returns when everything written to fd before the call is durable, errors of the batch sync
+  // are reported to every request of the batch
+  void sync(::cp::file_descriptor const& fd, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(fd);
+    request(fd, 0, 0, ec);
+  }
+
+  void sync(::cp::file_descriptor const& fd)
+  {
+    std::error_code ec;
+    sync(fd, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "sync_scheduler::sync fd: [", fd, "]");
+    }
+  }
+
+  // same as above, caller needs only [offset, offset + length) to be durable. the range is
+  // used only with write_ranges_first, the whole file is synced anyway
+  void sync(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length, std::error_code& ec)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(fd);
+    CP_ASSERT(offset >= 0);
+    CP_ASSERT(length > 0);
+    request(fd, offset, length, ec);
+  }
+
+  void sync(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length)
+  {
+    std::error_code ec;
+    sync(fd, offset, length, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "sync_scheduler::sync fd: [", fd, "], offset: [", offset, "], length: [", length, "]");
+    }
+  }
+
+  statistics stats() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return statistics_;
+  }
+
+private:
+  struct range
+  {
+    ::off_t offset;
+    ::off_t length;
+  };
+
+  // requests served by one sync
+  struct batch
+  {
+    std::vector<range> ranges;
+    std::size_t        requests = 0;
+    std::error_code    ec;
+    bool               done     = false;
+  };
+
+  struct file_state
+  {
+    std::condition_variable changed;
+    std::shared_ptr<batch>  next;              // batch new requests join
+    bool                    syncing = false;
+    std::size_t             users   = 0;       // threads inside request for this fd
+  };
+
+  void request(::cp::file_descriptor const& fd, ::off_t offset, ::off_t length, std::error_code& ec)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::unique_ptr<file_state>& slot = files_[fd.get()];
+    if (!slot) slot.reset(new file_state);
+    file_state& file = *slot;
+    ++file.users;
+
+    if (!file.next) file.next = std::make_shared<batch>();
+    const std::shared_ptr<batch> mine = file.next;
+    ++mine->requests;
+    if (0 != length) mine->ranges.push_back(range{ offset, length });
+    if (mine->requests >= options_.max_batch) file.changed.notify_all();
+
+    while (!mine->done)
+    {
+      if (file.syncing || file.next != mine)
+      {
+        file.changed.wait(lock);
+        continue;
+      }
+
+      // this thread syncs the batch, it first gives others up to max_delay to join
+      file.syncing = true;
+      if (options_.max_delay > clock::duration::zero())
+      {
+        const clock::time_point deadline = clock::now() + options_.max_delay;
+        while (mine->requests < options_.max_batch && file.changed.wait_until(lock, deadline) != std::cv_status::timeout) { }
+      }
+      file.next.reset();
+      lock.unlock();
+
+      std::error_code sync_ec;
+      run(fd, *mine, sync_ec);
+
+      lock.lock();
+      mine->ec     = sync_ec;
+      mine->done   = true;
+      file.syncing = false;
+      ++statistics_.syncs;
+      statistics_.requests += mine->requests;
+      file.changed.notify_all();
+    }
+
+    ec = mine->ec;
+    if (0 == --file.users) files_.erase(fd.get());
+  }
+
+  void run(::cp::file_descriptor const& fd, batch const& b, std::error_code& ec) noexcept
+  {
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+    if (options_.write_ranges_first)
+    {
+      for (range const& r : b.ranges)
+      {
+        // failure here is reported by the sync that follows
+        ::sync_file_range(fd, r.offset, r.length, SYNC_FILE_RANGE_WRITE);
+      }
+    }
+#else
+    (void)b;
+#endif
+    if (options_.data_only) ::cp::fdatasync(fd, ec);
+    else ::cp::fsync(fd, ec);
+  }
+
+  options const                                         options_;
+  mutable std::mutex                                    mutex_;
+  std::unordered_map<int, std::unique_ptr<file_state>>  files_;
+  statistics                                            statistics_;
+};
+
+} // namespace cp
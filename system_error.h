@@ -1,4 +1,4 @@
-#pragma once 
+#pragma once
 
 //          Copyright Nebojsa Vujnovic 2018 - 2020.
 // Distributed under the Boost Software License, Version 1.0.
@@ -6,61 +6,256 @@
 //          https://www.boost.org/LICENSE_1_0.txt)
 
 #include "config.h"
+#include "concatenate.h"
+#include "unique_handle.h"
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
 #include <system_error>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
+// when enabled CP_THROW_SYSTEM_ERROR_ARGS stores its arguments in the exception object and the
+// message is formatted only when what() is called for the first time
+#ifndef CP_DEFERRED_SYSTEM_ERROR_MESSAGE
+#define CP_DEFERRED_SYSTEM_ERROR_MESSAGE 0
+#endif
+
+// bytes reserved inside of the deferred exception for copies of string arguments, if arguments
+// do not fit the message is formatted eagerly
+#ifndef CP_DEFERRED_SYSTEM_ERROR_ARENA_SIZE
+#define CP_DEFERRED_SYSTEM_ERROR_ARENA_SIZE 256
+#endif
 
 namespace cp {
-  CP_FORCE_INLINE ::std::error_code 
+  CP_FORCE_INLINE ::std::error_code
   make_system_error_code( ) noexcept
   {
     return ::std::error_code{ errno, ::std::system_category() };
   }
 
-  CP_FORCE_INLINE ::std::error_code 
+  CP_FORCE_INLINE ::std::error_code
   make_system_error_code( int error_number) noexcept
   {
     return ::std::error_code{ error_number, ::std::system_category() };
   }
 
-  class system_error : public std::system_error 
+  class system_error : public std::system_error
   {
   public:
-    explicit system_error( 
-      char const* file, 
-      long line, 
+    // file and function are expected to be __FILE__ and __func__ so only pointers are kept
+    explicit system_error(
+      char const* file,
+      long line,
       char const* function,
       std::error_code ec,
       ::std::thread::id thread_id = ::std::this_thread::get_id()
-    ) 
-    : std::system_error{ec} 
+    )
+    : std::system_error{ec}
     , file(file)
     , line(line)
     , func(function)
     , thr_id(thread_id)
     { }
 
-    explicit system_error( 
-      char const* file, 
-      long line, 
+    explicit system_error(
+      char const* file,
+      long line,
       char const * function,
       std::error_code ec,
-      std::string const& msg, 
+      std::string const& msg,
       ::std::thread::id thread_id = ::std::this_thread::get_id()
-    ) 
-    : std::system_error{ec, msg} 
+    )
+    : std::system_error{ec, msg}
     , file(file)
     , line(line)
     , func(function)
     , thr_id(thread_id)
     { }
 
-    const std::string       file;
+    char const* const       file;
     const long              line;
-    const std::string       func;
+    char const* const       func;
     const std::thread::id   thr_id;
   };
+
+namespace detail {
+  struct deferred_arena
+  {
+    char        data[CP_DEFERRED_SYSTEM_ERROR_ARENA_SIZE];
+    std::size_t used = 0;
+  };
+
+  // string arguments are copied into the arena since pointers passed by the caller will not
+  // outlive stack unwinding, offsets are kept instead of pointers so that copies of the
+  // exception stay valid
+  struct deferred_string
+  {
+    std::size_t offset;
+    std::size_t size;
+  };
+
+  template <typename T, typename = void>
+  struct deferred_capture
+  {
+    using type = std::string;
+    static std::size_t arena_size(T const&) noexcept { return 0; }
+    static type capture(T const& value, deferred_arena&) { return ::cp::serialization_traits<T>::to_string(value); }
+    static type const& resolve(type const& value, deferred_arena const&) noexcept { return value; }
+  };
+
+  template <typename T>
+  struct deferred_capture<T, std::enable_if_t<std::is_arithmetic<T>::value>>
+  {
+    using type = T;
+    static std::size_t arena_size(T) noexcept { return 0; }
+    static type capture(T value, deferred_arena&) noexcept { return value; }
+    static type resolve(type value, deferred_arena const&) noexcept { return value; }
+  };
+
+  struct deferred_string_capture
+  {
+    using type = deferred_string;
+    static std::size_t arena_size(std::string_view value) noexcept { return value.size(); }
+    static type capture(std::string_view value, deferred_arena& arena) noexcept
+    {
+      const type result{ arena.used, value.size() };
+      std::memcpy(arena.data + arena.used, value.data(), value.size());
+      arena.used += value.size();
+      return result;
+    }
+    static std::string_view resolve(type value, deferred_arena const& arena) noexcept
+    {
+      return std::string_view(arena.data + value.offset, value.size);
+    }
+  };
+
+  template <>
+  struct deferred_capture<const char*> : deferred_string_capture
+  {
+    static std::string_view view(const char* value) noexcept { return value ? value : "nullptr"; }
+    static std::size_t arena_size(const char* value) noexcept { return view(value).size(); }
+    static type capture(const char* value, deferred_arena& arena) noexcept
+    {
+      return deferred_string_capture::capture(view(value), arena);
+    }
+  };
+
+  template <>
+  struct deferred_capture<char*> : deferred_capture<const char*> { };
+
+  template <>
+  struct deferred_capture<std::string> : deferred_string_capture { };
+
+  template <typename resource_t, typename traits>
+  struct deferred_capture< ::cp::unique_handle<resource_t, traits>,
+    std::enable_if_t<std::is_arithmetic<resource_t>::value || std::is_pointer<resource_t>::value>>
+  {
+    // handles are not copyable, the native value is kept and printed the same way to_string
+    // overloads of handle types print it
+    using type = resource_t;
+    static std::size_t arena_size(type) noexcept { return 0; }
+    static type capture(::cp::unique_handle<resource_t, traits> const& value, deferred_arena&) noexcept { return value.get(); }
+    static std::string resolve(type value, deferred_arena const&)
+    {
+      if (traits::invalid() == value) return "invalid";
+      if constexpr (std::is_pointer<resource_t>::value) {
+        return ::cp::to_string(std::uintptr_t(value));
+      } else {
+        return ::cp::to_string(value);
+      }
+    }
+  };
+} // namespace detail
+
+  template <typename... Args>
+  class deferred_system_error : public ::cp::system_error
+  {
+  public:
+    explicit deferred_system_error(
+      char const* file,
+      long line,
+      char const* function,
+      std::error_code ec,
+      Args const&... args
+    )
+    : ::cp::system_error{file, line, function, ec}
+    , args_(capture(args...))
+    { }
+
+    deferred_system_error(deferred_system_error const& other)
+    : ::cp::system_error(other)
+    , arena_(other.arena_)
+    , eager_(other.eager_)
+    , message_(other.message_)
+    , formatted_(other.formatted_)
+    , args_(other.args_)
+    { }
+
+    const char* what() const noexcept override
+    {
+      std::call_once(once_, [this] {
+        // copy of an exception whose message was already built
+        if (formatted_) return;
+        formatted_ = true;
+        try {
+          if (!eager_) message_ = format(std::index_sequence_for<Args...>{});
+          message_ += ": ";
+          message_ += code().message();
+        } catch (...) {
+          message_.clear();
+        }
+      });
+      return message_.empty() ? ::cp::system_error::what() : message_.c_str();
+    }
+
+  private:
+    using args_type = std::tuple<typename ::cp::detail::deferred_capture<Args>::type...>;
+
+    args_type capture(Args const&... args)
+    {
+      const std::size_t needed = (std::size_t(0) + ... + ::cp::detail::deferred_capture<Args>::arena_size(args));
+      if (CP_UNLIKELY(needed > sizeof(arena_.data))) {
+        eager_   = true;
+        message_ = ::cp::concat(args...);
+        return args_type{};
+      }
+      return args_type{ ::cp::detail::deferred_capture<Args>::capture(args, arena_)... };
+    }
+
+    template <std::size_t... I>
+    std::string format(std::index_sequence<I...>) const
+    {
+      return ::cp::concat(::cp::detail::deferred_capture<Args>::resolve(std::get<I>(args_), arena_)...);
+    }
+
+    // capture() fills arena_, eager_ and message_ so they have to be declared before args_
+    ::cp::detail::deferred_arena arena_;
+    bool                         eager_ = false;
+    mutable std::string          message_;
+    mutable bool                 formatted_ = false;   // message_ is final, copied with it
+    args_type                    args_;
+    mutable std::once_flag       once_;
+  };
+
+  template <typename... Args>
+  CP_FORCE_INLINE
+  ::cp::deferred_system_error<std::decay_t<Args const>...>
+  make_deferred_system_error(char const* file, long line, char const* function, std::error_code ec, Args const&... args)
+  {
+    return ::cp::deferred_system_error<std::decay_t<Args const>...>(file, line, function, ec, args...);
+  }
 }
 
 #define CP_THROW_SYSTEM_ERROR(x)  do { throw ::cp::system_error(__FILE__, __LINE__ ,__func__, (x) ); } while(0)
 #define CP_THROW_SYSTEM_ERROR_MSG(x, msg) do { throw ::cp::system_error(__FILE__, __LINE__, __func__, (x), (msg)); } while(0)
+
+#if (CP_DEFERRED_SYSTEM_ERROR_MESSAGE > 0)
+#define CP_THROW_SYSTEM_ERROR_ARGS(x, ...) do { throw ::cp::make_deferred_system_error(__FILE__, __LINE__, __func__, (x), __VA_ARGS__); } while(0)
+#else
+#define CP_THROW_SYSTEM_ERROR_ARGS(x, ...) CP_THROW_SYSTEM_ERROR_MSG(x, ::cp::concat(__VA_ARGS__))
+#endif
@@ -0,0 +1,289 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "posix.h"
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#if (_POSIX_C_SOURCE >= 200809L)
+
+namespace cp {
+
+namespace detail {
+  // ".tmp" followed by 16 hex digits, unique in the process and unlikely to exist
+  CP_FORCE_INLINE
+  void make_temp_name(char (&name)[21]) noexcept
+  {
+    static std::atomic<std::uint64_t> counter{ 0 };
+    std::uint64_t value = std::uint64_t(std::chrono::steady_clock::now().time_since_epoch().count())
+                        ^ (std::uint64_t(::getpid()) << 40)
+                        ^ (counter.fetch_add(1, std::memory_order_relaxed) * 0x9e3779b97f4a7c15ull);
+
+    name[0] = '.'; name[1] = 't'; name[2] = 'm'; name[3] = 'p';
+    for (std::size_t i = 0; i < 16; ++i, value >>= 4) name[4 + i] = "0123456789abcdef"[value & 0xf];
+    name[20] = '\0';
+  }
+}
+
+// file that is written first and given a name when it is complete. with O_TMPFILE the file has no
+// name at all until publish links it into the directory, nothing is left behind when the process
+// dies and readers never see a partial file. when the file system does not support O_TMPFILE a
+// hidden ".tmp" name is created in the directory instead, as mkstemp would, and removed when the
+// file is published or destroyed. dirfd is not owned and must outlive the object, it must not be
+// opened with O_PATH when durable is set, since the directory is synced through it
+class temp_file
+{
+  temp_file(temp_file const&) = delete;
+  temp_file& operator = (temp_file const&) = delete;
+
+public:
+  struct options
+  {
+    ::mode_t mode    = 0644;
+
+    // file data is synced before the file is published and the directory after it, so the name
+    // does not survive a crash without the data. without it nothing is synced
+    bool     durable = false;
+  };
+
+  temp_file(::cp::file_descriptor const& dirfd, options const& opts, std::error_code& ec)
+    : dirfd_(&dirfd), options_(opts)
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    create(ec);
+  }
+
+  temp_file(::cp::file_descriptor const& dirfd, options const& opts)
+    : dirfd_(&dirfd), options_(opts)
+  {
+    std::error_code ec;
+    create(ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "temp_file dirfd: [", dirfd, "]");
+    }
+  }
+
+  explicit temp_file(::cp::file_descriptor const& dirfd) : temp_file(dirfd, options()) { }
+
+  // unpublished file is discarded
+  ~temp_file()
+  {
+    if (!published_ && '\0' != name_[0]) ::unlinkat(*dirfd_, name_, 0);
+  }
+
+  // appends at the current offset
+  void write(const void* data, std::size_t nbytes, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    ::cp::write_all(fd_, data, nbytes, ec);
+  }
+
+  void write(const void* data, std::size_t nbytes)
+  {
+    std::error_code ec;
+    write(data, nbytes, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "temp_file::write fd: [", fd_, "], nbytes: [", nbytes, "]");
+    }
+  }
+
+  // gives the file name relative to the directory of the temp file, fails with EEXIST when name
+  // exists. the file stays open and can still be read and written
+  void publish(const char* name, std::error_code& ec) noexcept
+  {
+    publish(*dirfd_, name, ec);
+  }
+
+  void publish(const char* name)
+  {
+    publish(*dirfd_, name);
+  }
+
+  // same as above, newdirfd must be on the same file system
+  void publish(::cp::file_descriptor const& newdirfd, const char* name, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(newdirfd);
+    CP_ASSERT(name);
+    CP_ASSERT(!published_);
+
+    if (options_.durable)
+    {
+      ::cp::fdatasync(fd_, ec);
+      if (CP_UNLIKELY(ec)) return;
+    }
+
+    if ('\0' != name_[0]) link_hidden(newdirfd, name, ec);
+    else link_anonymous(newdirfd, name, ec);
+    if (CP_UNLIKELY(ec)) return;
+    published_ = true;
+
+    if (options_.durable) ::cp::fsync(newdirfd, ec);
+  }
+
+  void publish(::cp::file_descriptor const& newdirfd, const char* name)
+  {
+    std::error_code ec;
+    publish(newdirfd, name, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "temp_file::publish fd: [", fd_, "], dirfd: [", newdirfd, "], name: [", name, "]");
+    }
+  }
+
+  // gives the file name relative to the directory of the temp file, an existing file with that
+  // name is replaced atomically, readers see either the old or the new file
+  void replace(const char* name, std::error_code& ec) noexcept
+  {
+    replace(*dirfd_, name, ec);
+  }
+
+  void replace(const char* name)
+  {
+    replace(*dirfd_, name);
+  }
+
+  // same as above, newdirfd must be on the same file system
+  void replace(::cp::file_descriptor const& newdirfd, const char* name, std::error_code& ec) noexcept
+  {
+    static_assert(std::is_lvalue_reference<decltype(ec)>::value);
+    CP_ASSERT(!ec);
+    CP_ASSERT(newdirfd);
+    CP_ASSERT(name);
+    CP_ASSERT(!published_);
+
+    if (options_.durable)
+    {
+      ::cp::fdatasync(fd_, ec);
+      if (CP_UNLIKELY(ec)) return;
+    }
+
+    if ('\0' != name_[0])
+    {
+      ::cp::renameat(*dirfd_, name_, newdirfd, name, ec);
+    }
+    else
+    {
+      // anonymous file can not be renamed, it gets a hidden name next to name first
+      char hidden[21];
+      for (int attempt = 0; attempt < 100; ++attempt)
+      {
+        ::cp::detail::make_temp_name(hidden);
+        link_anonymous(newdirfd, hidden, ec);
+        if (ec != std::errc::file_exists) break;
+        ec.clear();
+      }
+      if (CP_UNLIKELY(ec)) return;
+
+      ::cp::renameat(newdirfd, hidden, newdirfd, name, ec);
+      if (CP_UNLIKELY(ec)) ::unlinkat(newdirfd, hidden, 0);
+    }
+    if (CP_UNLIKELY(ec)) return;
+    published_ = true;
+
+    if (options_.durable) ::cp::fsync(newdirfd, ec);
+  }
+
+  void replace(::cp::file_descriptor const& newdirfd, const char* name)
+  {
+    std::error_code ec;
+    replace(newdirfd, name, ec);
+    if (CP_UNLIKELY(ec))
+    {
+      CP_THROW_SYSTEM_ERROR_ARGS(ec, "temp_file::replace fd: [", fd_, "], dirfd: [", newdirfd, "], name: [", name, "]");
+    }
+  }
+
+  ::cp::file_descriptor const& fd()        const noexcept { return fd_;               }
+  bool                         published() const noexcept { return published_;        }
+
+  // false when the file has a hidden name because O_TMPFILE is not supported
+  bool                         anonymous() const noexcept { return '\0' == name_[0];  }
+
+private:
+  void create(std::error_code& ec) noexcept
+  {
+    CP_ASSERT(*dirfd_);
+    name_[0] = '\0';
+
+#if defined(O_TMPFILE)
+    fd_ = ::cp::file_descriptor(::openat(*dirfd_, ".", O_TMPFILE | O_RDWR | O_CLOEXEC, options_.mode));
+    if (CP_LIKELY(fd_)) return;
+    // EISDIR comes from kernels that do not know O_TMPFILE and see only O_DIRECTORY in it
+    if (EOPNOTSUPP != errno && EISDIR != errno && EINVAL != errno)
+    {
+      ec = ::cp::make_system_error_code();
+      return;
+    }
+#endif
+
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+      ::cp::detail::make_temp_name(name_);
+      fd_ = ::cp::file_descriptor(::openat(*dirfd_, name_, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, options_.mode));
+      if (CP_LIKELY(fd_)) return;
+      if (EEXIST != errno) break;
+    }
+    ec = ::cp::make_system_error_code();
+    name_[0] = '\0';
+  }
+
+  // moves the hidden name to name unless name exists
+  void link_hidden(::cp::file_descriptor const& newdirfd, const char* name, std::error_code& ec) noexcept
+  {
+#if defined(__linux__) && defined(RENAME_NOREPLACE)
+    ::cp::renameat2(*dirfd_, name_, newdirfd, name, RENAME_NOREPLACE, ec);
+    if (ec != std::errc::invalid_argument) return;
+    ec.clear();
+#endif
+    // file system without RENAME_NOREPLACE, the published name keeps the file and failure to
+    // remove the hidden one leaves only a stray name
+    ::cp::linkat(*dirfd_, name_, newdirfd, name, 0, ec);
+    if (CP_LIKELY(!ec)) ::unlinkat(*dirfd_, name_, 0);
+  }
+
+  void link_anonymous(::cp::file_descriptor const& newdirfd, const char* name, std::error_code& ec) noexcept
+  {
+#if defined(AT_EMPTY_PATH)
+    // needs CAP_DAC_READ_SEARCH, otherwise fails with ENOENT
+    if (use_empty_path_)
+    {
+      if (0 == ::linkat(fd_, "", newdirfd, name, AT_EMPTY_PATH)) return;
+      if (ENOENT != errno)
+      {
+        ec = ::cp::make_system_error_code();
+        return;
+      }
+      use_empty_path_ = false;
+    }
+#endif
+
+    char path[32] = "/proc/self/fd/";
+    std::to_chars(path + 14, path + sizeof(path) - 1, fd_.get());
+    if (CP_UNLIKELY(-1 == ::linkat(AT_FDCWD, path, newdirfd, name, AT_SYMLINK_FOLLOW))) ec = ::cp::make_system_error_code();
+  }
+
+  ::cp::file_descriptor const* dirfd_;
+  options const                options_;
+  ::cp::file_descriptor        fd_;
+  char                         name_[21];                // hidden name when O_TMPFILE is not used
+  bool                         published_      = false;
+  bool                         use_empty_path_ = true;
+};
+
+} // namespace cp
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+
+//          Copyright Nebojsa Vujnovic 2018 - 2020.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include "config.h"
+#include "assert.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cp {
+
+// fixed size pool of worker threads with a single fifo queue, destructor runs all tasks that are
+// already posted and joins workers. tasks must not throw
+class thread_pool
+{
+  thread_pool(thread_pool const&) = delete;
+  thread_pool& operator = (thread_pool const&) = delete;
+
+public:
+  static unsigned default_size() noexcept
+  {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  explicit thread_pool(unsigned threads = default_size())
+  {
+    CP_ASSERT(threads > 0);
+    workers_.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+      workers_.emplace_back([this] { run(); });
+    }
+  }
+
+  ~thread_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread& t : workers_) t.join();
+  }
+
+  template <typename F>
+  void post(F&& task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.emplace_back(std::forward<F>(task));
+    }
+    cv_.notify_one();
+  }
+
+  unsigned size() const noexcept { return unsigned(workers_.size()); }
+
+private:
+  void run() noexcept
+  {
+    for (;;)
+    {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (tasks_.empty()) return;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::mutex                        mutex_;
+  std::condition_variable           cv_;
+  std::deque<std::function<void()>> tasks_;
+  bool                              stop_ = false;
+  std::vector<std::thread>          workers_;
+};
+
+} // namespace cp
@@ -6,7 +6,11 @@
 //          https://www.boost.org/LICENSE_1_0.txt)
 
 #include <type_traits>
+#include <cstddef>
 #include <cstdlib>
+#include <memory>
+
+#include <stdlib.h>
 
 namespace cp {
 
@@ -20,4 +24,14 @@ struct free_deleter
 template < typename T>
 using unique_malloc_ptr = ::std::unique_ptr<T, ::cp::free_deleter>;
 
+// size bytes aligned to alignment, which must be a power of two multiple of sizeof(void*).
+// returns null when memory can not be allocated, memory is released with free
+inline
+::cp::unique_malloc_ptr<void> aligned_malloc(std::size_t alignment, std::size_t size) noexcept
+{
+  void* memory = nullptr;
+  if (0 != ::posix_memalign(&memory, alignment, size)) memory = nullptr;
+  return ::cp::unique_malloc_ptr<void>(memory);
+}
+
 }
\ No newline at end of file